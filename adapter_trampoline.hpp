@@ -0,0 +1,142 @@
+#ifndef ADAPTER_TRAMPOLINE_H
+#define ADAPTER_TRAMPOLINE_H
+#include <initializer_list>
+#include "c_trampoline.hpp"
+
+/**
+ * @brief Adapts a plain function whose parameters don't line up with the callback it has to serve.
+ *
+ * The thunk is assembled at run time from a map saying where each of the target's parameters comes from:
+ * one of the callback's own arguments (thumb_asm::arg(i)) or a bound value (thumb_asm::bound(i)).
+ * So a C API that wants `void (*)(uint32_t)` can call `void handler(uint32_t x, void* context)`, or one
+ * that passes its context last can call something expecting it first, without writing a wrapper for each.
+ *
+ * Only register arguments are handled, so at most four on either side, and if the target takes four
+ * arguments at least one of them has to be bound (there's no other free register to hold the target address).
+ * An impossible map leaves ok() false and the thunk as a udf, so calling it faults straight away.
+ *
+ * @warning Same caveats as c_trampoline: data is executed as code, and destruction while the thunk can
+ * still be invoked is your problem.
+ *
+ * On the host, integer and pointer arguments only.
+ *
+ * @tparam R Return type of the callback; the target's return value is passed straight through, so it must match.
+ * @tparam Args Arguments the callback receives.
+ */
+template<typename Signature> struct adapter_trampoline;
+
+template<typename R, FitsInRegister... Args>
+requires RegisterReturn<R> && NotTooManyArgs<4, Args...>
+struct C_TRAMPOLINE_LAYOUT(4) adapter_trampoline<R(Args...)>
+{
+        typedef R (*function_pointer)(Args...);
+        /**
+         * @brief Most values that can be bound.
+         */
+        static constexpr size_t max_literals = 4;
+
+        /**
+         * @param target Function to call.
+         * @param map One entry per parameter of target saying where its value comes from.
+         * @param literals Values for thumb_asm::bound(0) onwards. Pointers need a reinterpret_cast to uintptr_t.
+         */
+        template<FitsInRegister... TargetArgs>
+        adapter_trampoline(R (*target)(TargetArgs...), std::initializer_list<thumb_asm::source> map, std::initializer_list<uintptr_t> literals = { })
+        {
+            bool valid = map.size() == sizeof...(TargetArgs) && literals.size() <= max_literals;
+            size_t i = 0;
+            for (uintptr_t value : literals)
+                if (i < max_literals)
+                    literal[i++] = value;
+            for (thumb_asm::source s : map)
+                if (s.index >= (s.kind == thumb_asm::source::literal ? literals.size() : sizeof...(Args)))
+                    valid = false;
+            // Assembled on the host too, and thrown away, so both accept exactly the same maps.
+            thumb_asm::code<thumb_asm::max_adapter_length> c;
+            valid = valid && thumb_asm::assemble_adapter(c, map.begin(), map.size(), sizeof...(Args), literals_at, target_at);
+#ifdef __thumb__
+            static_assert(offsetof(adapter_trampoline, literal) == literals_at);
+            static_assert(offsetof(adapter_trampoline, target) == target_at);
+            this->target = reinterpret_cast<uintptr_t>(target);
+            for (i = 0; i < thumb_asm::max_adapter_length; i++)
+                code[i] = valid && i < c.size ? c.op[i] : thumb_asm::udf(0xFE);
+#else
+            this->target = reinterpret_cast<void (*)()>(target);
+            i = 0;
+            for (thumb_asm::source s : map)
+                if (i < 4)
+                    sources[i++] = s;
+            count = map.size();
+#endif /* __thumb__ */
+            assembled = valid;
+        }
+
+        adapter_trampoline(const adapter_trampoline&) = delete;
+        adapter_trampoline& operator=(const adapter_trampoline&) = delete;
+
+        /**
+         * @brief False if map couldn't be turned into a thunk, in which case calling it faults.
+         */
+        bool ok() const
+        {
+            return assembled;
+        }
+
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        operator function_pointer() const
+        {
+            return get_callback();
+        }
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        function_pointer get_callback() const
+        {
+#ifdef __thumb__
+            return reinterpret_cast<function_pointer>((uint8_t*)&code + 1); // Plus one to stay in Thumb mode.
+#else
+            return host_slot.get(const_cast<adapter_trampoline*>(this), &host_invoke);
+#endif /* __thumb__ */
+        }
+
+    private:
+        static constexpr size_t literals_at = thumb_asm::max_adapter_length * 2;
+        static constexpr size_t target_at = literals_at + max_literals * sizeof(uint32_t);
+
+#ifdef __thumb__
+        uint16_t volatile __attribute__((aligned(4))) code[thumb_asm::max_adapter_length];
+#endif /* __thumb__ */
+        uintptr_t literal[max_literals] = { }; // DO NOT change the order of this member or code will be invalid!
+#ifdef __thumb__
+        uintptr_t target; // DO NOT change the order of this member or code will be invalid!
+#else
+        void (*target)();
+        thumb_asm::source sources[4] = { };
+        size_t count = 0;
+        c_trampoline_host::slot<R, Args...> host_slot;
+
+        static R host_invoke(void* context, Args... args)
+        {
+            adapter_trampoline& t = *static_cast<adapter_trampoline*>(context);
+            if (!t.assembled)
+                __builtin_trap(); // Where the Thumb thunk would hit its udf.
+            uintptr_t in[] = { register_word(args)..., 0 };
+            uintptr_t out[4] = { };
+            for (size_t i = 0; i < t.count; i++)
+                out[i] = t.sources[i].kind == thumb_asm::source::literal ? t.literal[t.sources[i].index] : in[t.sources[i].index];
+            switch (t.count)
+            {
+                case 0: return reinterpret_cast<R (*)()>(t.target)();
+                case 1: return reinterpret_cast<R (*)(uintptr_t)>(t.target)(out[0]);
+                case 2: return reinterpret_cast<R (*)(uintptr_t, uintptr_t)>(t.target)(out[0], out[1]);
+                case 3: return reinterpret_cast<R (*)(uintptr_t, uintptr_t, uintptr_t)>(t.target)(out[0], out[1], out[2]);
+                default: return reinterpret_cast<R (*)(uintptr_t, uintptr_t, uintptr_t, uintptr_t)>(t.target)(out[0], out[1], out[2], out[3]);
+            }
+        }
+#endif /* __thumb__ */
+        bool assembled;
+};
+
+#endif /* ADAPTER_TRAMPOLINE_H */
@@ -0,0 +1,132 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @file
+ * @brief What the host benchmarks share: timing warm and cold calls, and writing results as JSON.
+ *
+ * The benchmarks build against host/pico_mock.hpp like any other host build, e.g.
+ * @code
+ * g++ -std=c++20 -O2 -I. -Ihost bench/dispatch.cpp -o dispatch && ./dispatch > dispatch.json
+ * @endcode
+ * They time the host backend on whatever machine runs them, which is good for catching regressions and
+ * comparing approaches relative to each other, but says nothing absolute about a Cortex-M0+.
+ * The Thumb figures they print come from thumb_model, not from a clock.
+ */
+namespace bench
+{
+    typedef std::chrono::steady_clock clock;
+
+    /**
+     * @brief Stops the compiler from deciding a result isn't needed.
+     */
+    template<typename V> inline void keep(const V& value)
+    {
+        __asm volatile ("" :: "g" (&value) : "memory");
+    }
+
+    /**
+     * @brief Nanoseconds per call of f, averaged over calls calls after a warm-up.
+     */
+    template<typename F> double warm_ns(size_t calls, F&& f)
+    {
+        for (size_t i = 0; i < calls / 16; i++)
+            f(i);
+        auto start = clock::now();
+        for (size_t i = 0; i < calls; i++)
+            f(i);
+        return std::chrono::duration<double, std::nano>(clock::now() - start).count() / calls;
+    }
+
+    /**
+     * @brief Pushes everything else out of the data caches by writing a buffer bigger than they are.
+     */
+    inline void evict_caches()
+    {
+        static std::vector<uint8_t> junk(64 << 20);
+        for (size_t i = 0; i < junk.size(); i += 64)
+            junk[i]++;
+        keep(junk[0]);
+    }
+
+    /**
+     * @brief Median nanoseconds for one call of f made straight after evict_caches(), over runs runs.
+     *
+     * Includes the clock's own overhead, which is also reported (with f doing nothing) so it can be subtracted.
+     */
+    template<typename F> double cold_ns(unsigned runs, F&& f)
+    {
+        std::vector<double> samples;
+        for (unsigned run = 0; run < runs; run++)
+        {
+            evict_caches();
+            auto start = clock::now();
+            f(run);
+            samples.push_back(std::chrono::duration<double, std::nano>(clock::now() - start).count());
+        }
+        std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+        return samples[samples.size() / 2];
+    }
+
+    /**
+     * @brief Value at fraction q (0 to 1) of samples, which get sorted.
+     */
+    inline double quantile(std::vector<double>& samples, double q)
+    {
+        std::sort(samples.begin(), samples.end());
+        return samples[std::min(samples.size() - 1, size_t(q * samples.size()))];
+    }
+
+    /**
+     * @brief One JSON object per benchmark: a name, some settings, and an array of result rows, all numbers.
+     */
+    struct report
+    {
+            typedef std::vector<std::pair<std::string, double>> fields;
+
+            report(std::string name) : name { std::move(name) } { }
+
+            void setting(std::string key, double value)
+            {
+                settings.emplace_back(std::move(key), value);
+            }
+            void row(std::string label, fields values)
+            {
+                rows.emplace_back(std::move(label), std::move(values));
+            }
+
+            void print(FILE* out = stdout) const
+            {
+                fprintf(out, "{\n  \"benchmark\": \"%s\",\n  \"settings\": { ", name.c_str());
+                print_fields(out, settings);
+                fprintf(out, " },\n  \"results\": [\n");
+                for (size_t i = 0; i < rows.size(); i++)
+                {
+                    fprintf(out, "    { \"name\": \"%s\", ", rows[i].first.c_str());
+                    print_fields(out, rows[i].second);
+                    fprintf(out, " }%s\n", i + 1 < rows.size() ? "," : "");
+                }
+                fprintf(out, "  ]\n}\n");
+            }
+
+        private:
+            std::string name;
+            fields settings;
+            std::vector<std::pair<std::string, fields>> rows;
+
+            static void print_fields(FILE* out, const fields& values)
+            {
+                for (size_t i = 0; i < values.size(); i++)
+                    fprintf(out, "\"%s\": %.6g%s", values[i].first.c_str(), values[i].second, i + 1 < values.size() ? ", " : "");
+            }
+    };
+}
+
+#endif /* BENCH_H */
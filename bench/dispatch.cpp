@@ -0,0 +1,143 @@
+/**
+ * @file
+ * @brief Cost of getting from a C callback to a method: c_trampoline against the usual hand-written adapters.
+ *
+ * Every contender is timed for zero to three arguments, called through a function pointer the compiler can't
+ * see through, warm (in a loop) and cold (one call after the caches have been flushed). The 0 argument ones
+ * are timed again as IRQ handlers raised through the mock. The thumb rows are the model's Cortex-M0+ cycle
+ * counts and RAM bytes for the real thunks, for tracking alongside; the timed rows measure the host backend.
+ *
+ * @code
+ * g++ -std=c++20 -O2 -I. -Ihost bench/dispatch.cpp -o dispatch && ./dispatch > dispatch.json
+ * nm -C -S --size-sort dispatch | grep -E 'adapter|pool<.*>::call<0ul>'   # host code size of each contender
+ * @endcode
+ */
+#include <functional>
+#include "pico_mock.hpp"
+#include "c_trampoline.hpp"
+#include "bench/bench.hpp"
+
+struct driver
+{
+        uint32_t volatile total = 0;
+
+        template<typename... Args> __attribute__((noinline)) void on_event(Args... args)
+        {
+            total = total + (1 + ... + args);
+        }
+};
+
+driver the_driver;
+driver* volatile global_driver = &the_driver;
+
+// extern "C" adapter reading a global object pointer.
+template<typename... Args> void global_adapter(Args... args)
+{
+    global_driver->on_event(args...);
+}
+
+// The same as a captureless lambda reading the global.
+template<typename... Args> void (*const lambda_adapter)(Args...) = [](Args... args) { global_driver->on_event(args...); };
+
+// Static slot table: { object, method } pairs and an adapter per slot.
+template<typename... Args> struct slot_table
+{
+    struct entry
+    {
+        driver* self;
+        void (driver::*method)(Args...);
+    };
+    static inline entry entries[4] = { { &the_driver, &driver::on_event<Args...> } };
+
+    template<size_t I> static void adapter(Args... args)
+    {
+        (entries[I].self->*entries[I].method)(args...);
+    }
+};
+
+// std::function stored in a global.
+template<typename... Args> std::function<void(Args...)> function_handler = [](Args... args) { the_driver.on_event(args...); };
+template<typename... Args> void function_adapter(Args... args)
+{
+    function_handler<Args...>(args...);
+}
+
+// SDK-style userdata, for APIs that have it.
+template<typename... Args> void userdata_adapter(void* context, Args... args)
+{
+    static_cast<driver*>(context)->on_event(args...);
+}
+
+constexpr size_t calls = 5000000;
+constexpr unsigned cold_runs = 101;
+
+template<typename... Args> void time(bench::report& r, const std::string& name, void (*volatile const& callback)(Args...))
+{
+    auto call = [&]([[maybe_unused]] size_t i) { callback(static_cast<Args>(i)...); };
+    double warm = bench::warm_ns(calls, call);
+    double cold = bench::cold_ns(cold_runs, call);
+    r.row(name + "/" + std::to_string(sizeof...(Args)) + "_args", { { "warm_ns_per_call", warm }, { "calls_per_ns", 1 / warm }, { "cold_ns", cold } });
+}
+
+template<typename... Args> void time_all(bench::report& r)
+{
+    c_trampoline<driver, void, Args...> trampoline { the_driver, &driver::on_event<Args...> };
+    void (*volatile callback)(Args...) = trampoline.get_callback();
+    time(r, "c_trampoline", callback);
+    callback = &global_adapter<Args...>;
+    time(r, "global_adapter", callback);
+    callback = lambda_adapter<Args...>;
+    time(r, "lambda_adapter", callback);
+    callback = &slot_table<Args...>::template adapter<0>;
+    time(r, "slot_table", callback);
+    callback = &function_adapter<Args...>;
+    time(r, "std_function", callback);
+
+    void (*volatile with_context)(void*, Args...) = &userdata_adapter<Args...>;
+    auto call = [&]([[maybe_unused]] size_t i) { with_context(&the_driver, static_cast<Args>(i)...); };
+    double warm = bench::warm_ns(calls, call);
+    double cold = bench::cold_ns(cold_runs, call);
+    r.row("userdata/" + std::to_string(sizeof...(Args)) + "_args", { { "warm_ns_per_call", warm }, { "calls_per_ns", 1 / warm }, { "cold_ns", cold } });
+}
+
+template<size_t Count> void thumb_row(bench::report& r)
+{
+    typedef adapter_code<literals_then_arguments<1, Count>> code;
+    // Opcodes, then self and the pointer-to-member, which are one and two words on the target.
+    r.row("thumb/c_trampoline/" + std::to_string(Count) + "_args", { { "m0plus_cycles", code::cycles }, { "ram_bytes", code::length * 2 + 3 * 4 } });
+}
+
+int main()
+{
+    bench::report r { "dispatch" };
+    r.setting("warm_calls", calls);
+    r.setting("cold_runs", cold_runs);
+
+    time_all<>(r);
+    time_all<uint32_t>(r);
+    time_all<uint32_t, uint32_t>(r);
+    time_all<uint32_t, uint32_t, uint32_t>(r);
+    r.row("clock_overhead", { { "cold_ns", bench::cold_ns(cold_runs, [](size_t) { }) } });
+
+    // The same handlers as the mock NVIC would run them; mostly measures the mock, so compare the rows with each other.
+    c_trampoline<driver, void> irq_trampoline { the_driver, &driver::on_event<> };
+    auto time_irq = [&](const char* name, irq_handler_t handler)
+    {
+        irq_set_exclusive_handler(DMA_IRQ_0, handler);
+        irq_set_enabled(DMA_IRQ_0, true);
+        double warm = bench::warm_ns(calls / 10, [](size_t) { pico_mock::raise_irq(DMA_IRQ_0); });
+        irq_set_enabled(DMA_IRQ_0, false);
+        irq_remove_handler(DMA_IRQ_0, handler);
+        r.row(name, { { "warm_ns_per_call", warm }, { "calls_per_ns", 1 / warm } });
+    };
+    time_irq("mock_irq/c_trampoline", irq_trampoline);
+    time_irq("mock_irq/global_adapter", &global_adapter<>);
+    time_irq("mock_irq/lambda_adapter", lambda_adapter<>);
+    time_irq("mock_irq/std_function", &function_adapter<>);
+
+    thumb_row<0>(r);
+    thumb_row<1>(r);
+    thumb_row<2>(r);
+    thumb_row<3>(r);
+    r.print();
+}
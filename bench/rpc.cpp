@@ -0,0 +1,95 @@
+/**
+ * @file
+ * @brief Latency of rpc_channel round trips and throughput of post() bursts, driven through the mock's two cores.
+ *
+ * Core 1 serves a procedure and core 0 calls it: call().get() round trips are timed one by one for the
+ * latency distribution, then post() on its own and in bursts for throughput, with the stats() counters
+ * giving how many calls each SIO interrupt ran. The mock delivers a FIFO interrupt as soon as a word is pushed,
+ * so this times the protocol and dispatch on the host, not the SIO hardware.
+ *
+ * @code
+ * g++ -std=c++20 -O2 -I. -Ihost bench/rpc.cpp -o rpc && ./rpc > rpc.json
+ * @endcode
+ */
+#include "pico_mock.hpp"
+#include "pico_rpc.hpp"
+#include "bench/bench.hpp"
+
+struct mixer
+{
+        uint32_t gain[4] = { };
+
+        uint32_t set_gain(uint32_t channel, uint32_t value, uint32_t)
+        {
+            uint32_t old = gain[channel % 4];
+            gain[channel % 4] = value;
+            return old;
+        }
+};
+
+int main()
+{
+    constexpr size_t round_trips = 200000;
+    constexpr size_t posts = 1000000;
+    bench::report r { "rpc" };
+    r.setting("round_trips", round_trips);
+    r.setting("posts", posts);
+
+    mixer the_mixer;
+    c_trampoline<mixer, uint32_t, uint32_t, uint32_t, uint32_t> set_gain_call { the_mixer, &mixer::set_gain };
+    rpc_channel<> rpc;
+    rpc.serve(5, set_gain_call);
+    pico_mock::as_core(1, [&] { rpc.listen(); });
+    rpc.listen();
+
+    std::vector<double> samples;
+    samples.reserve(round_trips);
+    uint32_t check = 0;
+    for (size_t i = 0; i < round_trips; i++)
+    {
+        auto start = bench::clock::now();
+        check += rpc.call(5, uint32_t(i), uint32_t(i)).get();
+        samples.push_back(std::chrono::duration<double, std::nano>(bench::clock::now() - start).count());
+    }
+    bench::keep(check);
+    double total = 0;
+    for (double s : samples)
+        total += s;
+    r.row("call_get", { { "mean_ns", total / round_trips }, { "min_ns", bench::quantile(samples, 0) },
+        { "median_ns", bench::quantile(samples, 0.5) }, { "p99_ns", bench::quantile(samples, 0.99) },
+        { "calls_per_s", round_trips / total * 1e9 } });
+
+    // One post at a time, each taking its own interrupt on core 1.
+    {
+        rpc_channel<>::statistics before = rpc.stats(1);
+        auto start = bench::clock::now();
+        for (size_t i = 0; i < posts; i++)
+            rpc.post(5, uint32_t(i), uint32_t(i));
+        double ns = std::chrono::duration<double, std::nano>(bench::clock::now() - start).count();
+        const rpc_channel<>::statistics& after = rpc.stats(1);
+        double served = after.served - before.served;
+        r.row("post", { { "ns_per_post", ns / served }, { "posts_per_s", served / ns * 1e9 },
+            { "calls_per_interrupt", served / (after.interrupts - before.interrupts) } });
+    }
+    // Bursts posted with interrupts masked, so core 1 takes them all in one interrupt. Posts with no arguments
+    // are one word each, so up to the FIFO's depth fit without core 0 having to serve anything.
+    for (size_t burst : { 1, 2, 4, SIO_FIFO_DEPTH })
+    {
+        rpc_channel<>::statistics before = rpc.stats(1);
+        auto start = bench::clock::now();
+        for (size_t i = 0; i < posts; i += burst)
+        {
+            uint32_t status = save_and_disable_interrupts();
+            for (size_t j = 0; j < burst; j++)
+                rpc.post(5);
+            restore_interrupts(status);
+        }
+        double ns = std::chrono::duration<double, std::nano>(bench::clock::now() - start).count();
+        const rpc_channel<>::statistics& after = rpc.stats(1);
+        double served = after.served - before.served;
+        r.row("post_burst_" + std::to_string(burst), { { "ns_per_post", ns / served }, { "posts_per_s", served / ns * 1e9 },
+            { "calls_per_interrupt", served / (after.interrupts - before.interrupts) } });
+    }
+    r.row("totals", { { "core0_stalls", double(rpc.stats(0).stalls) }, { "core1_errors", double(rpc.stats(1).errors) } });
+    r.print();
+}
@@ -0,0 +1,100 @@
+/**
+ * @file
+ * @brief Parallel qsort with per-thread sort keys: comparator_trampoline against a thread_local comparator and qsort_r.
+ *
+ * Each thread sorts its own array of records by its own key, the case that makes a plain global comparator
+ * unusable. Run it on a machine with at least as many cores as threads, or the threads just take turns and
+ * the result says nothing about contention. The core count is in the settings so results can be checked.
+ *
+ * @code
+ * g++ -std=c++20 -O2 -pthread -I. -Ihost bench/sort.cpp -o sort && ./sort [threads] [records] > sort.json
+ * @endcode
+ */
+#include <stdlib.h>
+#include <random>
+#include <thread>
+#include "comparator_trampoline.hpp"
+#include "bench/bench.hpp"
+
+struct record
+{
+    uint32_t key[4];
+};
+
+struct by_key
+{
+    size_t k;
+
+    int operator()(const record& a, const record& b) const
+    {
+        return a.key[k] < b.key[k] ? -1 : a.key[k] > b.key[k];
+    }
+};
+
+thread_local by_key* current_key;
+int thread_local_compare(const void* a, const void* b)
+{
+    return (*current_key)(*static_cast<const record*>(a), *static_cast<const record*>(b));
+}
+int context_compare(const void* a, const void* b, void* context)
+{
+    return (*static_cast<by_key*>(context))(*static_cast<const record*>(a), *static_cast<const record*>(b));
+}
+
+/**
+ * @brief Seconds for threads threads to each sort records records with sort_one, or negative if any came out unsorted.
+ */
+template<typename F> double run(unsigned threads, size_t records, F sort_one)
+{
+    std::vector<std::vector<record>> data(threads, std::vector<record>(records));
+    for (unsigned t = 0; t < threads; t++)
+    {
+        std::mt19937 random { t };
+        for (record& r : data[t])
+            for (uint32_t& k : r.key)
+                k = random();
+    }
+    auto start = bench::clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++)
+        workers.emplace_back([&, t] { by_key key { t % 4 }; sort_one(key, data[t]); });
+    for (std::thread& w : workers)
+        w.join();
+    double seconds = std::chrono::duration<double>(bench::clock::now() - start).count();
+    for (unsigned t = 0; t < threads; t++)
+        for (size_t i = 1; i < records; i++)
+            if (data[t][i - 1].key[t % 4] > data[t][i].key[t % 4])
+                return -1;
+    return seconds;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned cores = std::thread::hardware_concurrency();
+    unsigned threads = argc > 1 ? unsigned(atoi(argv[1])) : cores;
+    size_t records = argc > 2 ? size_t(atol(argv[2])) : size_t(1) << 20;
+    bench::report r { "sort" };
+    r.setting("cores", cores);
+    r.setting("threads", threads);
+    r.setting("records_per_thread", records);
+
+    auto row = [&](const char* name, double seconds)
+    {
+        r.row(name, { { "seconds", seconds }, { "records_per_s", seconds > 0 ? threads * records / seconds : 0 }, { "sorted", seconds > 0 } });
+    };
+    row("comparator_trampoline", run(threads, records, [](by_key& key, std::vector<record>& v)
+    {
+        comparator_trampoline<record, by_key> comparator { key };
+        comparator.sort(v.data(), v.size());
+    }));
+    row("thread_local", run(threads, records, [](by_key& key, std::vector<record>& v)
+    {
+        current_key = &key;
+        qsort(v.data(), v.size(), sizeof(record), &thread_local_compare);
+    }));
+    row("qsort_r", run(threads, records, [](by_key& key, std::vector<record>& v)
+    {
+        qsort_r(v.data(), v.size(), sizeof(record), &context_compare, &key);
+    }));
+    r.print();
+}
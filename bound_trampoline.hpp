@@ -0,0 +1,109 @@
+#ifndef BOUND_TRAMPOLINE_H
+#define BOUND_TRAMPOLINE_H
+#include "c_trampoline.hpp"
+
+/**
+ * @brief A c_trampoline that also passes constant leading arguments to the method.
+ *
+ * The constants are literals in the trampoline that the thunk loads straight into registers,
+ * so one `void handler(uint32_t channel)` member can serve several `irq_handler_t`s with the channel
+ * baked in, and recovering it costs nothing per call.
+ *
+ * @code
+ * bound_trampoline<dma_driver, void(), uint32_t> channel0 { *this, &dma_driver::on_irq, 0 };
+ * @endcode
+ *
+ * self, the constants, and the C arguments together must fit in r0-r3.
+ *
+ * @warning Same caveats as c_trampoline.
+ *
+ * @tparam T Class the method belongs to.
+ * @tparam Callback C callback signature being served, e.g. void() for irq_handler_t.
+ * @tparam Bound Types of the constant arguments, which come before the C arguments in the method's parameters.
+ */
+template<typename T, typename Callback, FitsInRegister... Bound> struct bound_trampoline;
+
+template<typename T, typename R, FitsInRegister... Args, FitsInRegister... Bound>
+requires RegisterReturn<R> && (sizeof...(Bound) > 0) && NotTooManyArgs<3, Bound..., Args...>
+struct C_TRAMPOLINE_LAYOUT(4) bound_trampoline<T, R(Args...), Bound...>
+{
+        typedef R (T::*member_function_pointer)(Bound..., Args...);
+        typedef R (*function_pointer)(Args...);
+
+        /**
+         * @param self Object to bind this wrapper to.
+         * @param method Member function pointer you want adapted for use with C.
+         * @param values Constants passed as the method's leading arguments on every call.
+         */
+        constexpr bound_trampoline(T& self, member_function_pointer method, Bound... values)
+            : self { &self }, bound { register_word(values)... }, method { method }
+        {
+#ifdef __thumb__
+            static_assert(offsetof(bound_trampoline, self) == Code::literals_at);
+            static_assert(offsetof(bound_trampoline, method) == Code::literals_at + sizeof(T*) + sizeof(bound));
+#endif /* __thumb__ */
+        }
+
+        bound_trampoline(const bound_trampoline&) = delete;
+        bound_trampoline& operator=(const bound_trampoline&) = delete;
+
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        operator function_pointer() const
+        {
+            return get_callback();
+        }
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        function_pointer get_callback() const
+        {
+#ifdef __thumb__
+            return reinterpret_cast<function_pointer>((uint8_t*)&asm_code + 1); // Plus one to stay in Thumb mode.
+#else
+            return host_slot.get(const_cast<bound_trampoline*>(this), &host_invoke);
+#endif /* __thumb__ */
+        }
+
+        /**
+         * @brief Changes the method this trampoline will access; the constants stay as they are.
+         */
+        void set_method(member_function_pointer new_method)
+        {
+            method = new_method;
+        }
+        /**
+         * @brief Returns the currently active pointer-to-member this trampoline adapts.
+         */
+        member_function_pointer get_method() const
+        {
+            return method;
+        }
+
+        /**
+         * @brief Cortex-M0+ cycles spent in the trampoline, from the first instruction up to and including the branch to method.
+         */
+        static constexpr unsigned thunk_cycles = adapter_code<literals_then_arguments<1 + sizeof...(Bound), sizeof...(Args)>>::cycles;
+
+    private:
+        typedef adapter_code<literals_then_arguments<1 + sizeof...(Bound), sizeof...(Args)>> Code;
+        Code asm_code;
+        T* const self; // DO NOT change the order of this member or asm_code will be invalid!
+        uintptr_t const bound[sizeof...(Bound)]; // DO NOT change the order of this member or asm_code will be invalid!
+        member_function_pointer method; // DO NOT change the order of this member or asm_code will be invalid!
+#ifndef __thumb__
+        c_trampoline_host::slot<R, Args...> host_slot;
+        static R host_invoke(void* context, Args... args)
+        {
+            bound_trampoline& t = *static_cast<bound_trampoline*>(context);
+            return t.call(std::index_sequence_for<Bound...>(), args...);
+        }
+        template<size_t... I> R call(std::index_sequence<I...>, Args... args)
+        {
+            return (self->*method)(from_register_word<Bound>(bound[I])..., args...);
+        }
+#endif /* __thumb__ */
+};
+
+#endif /* BOUND_TRAMPOLINE_H */
@@ -1,6 +1,21 @@
 #ifndef C_TRAMPOLINE_H
 #define C_TRAMPOLINE_H
 #include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <bit>
+#include <tuple>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include "thumb_asm.hpp"
+#include "thumb_model.hpp"
+#ifndef __thumb__
+#include "c_trampoline_host.hpp"
+#endif /* __thumb__ */
+#ifdef C_TRAMPOLINE_CHECKED
+#include "c_trampoline_checked.hpp"
+#endif /* C_TRAMPOLINE_CHECKED */
 
 #ifndef __cpp_concepts
 #error "Support for C++ concepts is required."
@@ -8,17 +23,162 @@
 
 /**
  * @brief Check if a type can be passed in a single Thumb register. 
+ * 
+ * On the host this is a pointer-sized register instead, so pointer arguments still work there.
  */
+#ifdef __thumb__
 template<typename T> concept FitsInRegister = sizeof(T) <= 4;
+#else
+template<typename T> concept FitsInRegister = sizeof(T) <= sizeof(void*);
+#endif /* __thumb__ */
+/**
+ * @brief Layout attributes for a trampoline: packed on the target, so the literals sit exactly where the thunk loads them.
+ *
+ * Nothing runs that layout on the host, and its c_trampoline_host::slot can't be packed, so there it's only aligned.
+ */
+#ifdef __thumb__
+#define C_TRAMPOLINE_LAYOUT(alignment) __attribute__((packed, aligned(alignment)))
+#else
+#define C_TRAMPOLINE_LAYOUT(alignment) __attribute__((aligned(alignment)))
+#endif /* __thumb__ */
 /**
  * @brief Check if a type is actually just void.
  */
-template<typename T> concept VoidReturn = requires (T (*x)()) { x(); };
+template<typename T> concept VoidReturn = std::is_void_v<T>;
+/**
+ * @brief Check if a type comes back in r0 (or r0 and r1), so the thunk's registers still line up.
+ *
+ * Scalars of up to 8 bytes do. Anything the AAPCS calls a composite is only returned in r0 when it's at most
+ * 4 bytes and trivially copyable; otherwise the caller passes a hidden pointer to the result in r0, which
+ * would push self and every argument along by one register.
+ */
+template<typename T> concept RegisterReturn = VoidReturn<T>
+    || (std::is_scalar_v<T> && sizeof(T) <= 8)
+    || ((std::is_class_v<T> || std::is_union_v<T>) && std::is_trivially_copyable_v<T> && sizeof(T) <= 4);
 /**
  * @brief Check if the number of arguments passed is less-than-or-equal-to some value.
  */
 template<int Count, typename ... Args> concept NotTooManyArgs = sizeof...(Args) <= Count; 
 
+/**
+ * @brief Converts a value that fits in a register into the word it would travel in.
+ */
+template<FitsInRegister V> constexpr uintptr_t register_word(V value)
+{
+    if constexpr (std::is_pointer_v<V>)
+        return reinterpret_cast<uintptr_t>(value);
+    else if constexpr (std::is_integral_v<V> || std::is_enum_v<V>)
+        return static_cast<uintptr_t>(value);
+    else if constexpr (sizeof(V) == sizeof(uint32_t))
+        return std::bit_cast<uint32_t>(value);
+    else if constexpr (sizeof(V) == sizeof(uint16_t))
+        return std::bit_cast<uint16_t>(value);
+    else
+        return std::bit_cast<uint8_t>(value);
+}
+/**
+ * @brief Inverse of register_word.
+ */
+template<FitsInRegister V> constexpr V from_register_word(uintptr_t word)
+{
+    if constexpr (std::is_pointer_v<V>)
+        return reinterpret_cast<V>(word);
+    else if constexpr (std::is_integral_v<V> || std::is_enum_v<V>)
+        return static_cast<V>(word);
+    else if constexpr (sizeof(V) == sizeof(uint32_t))
+        return std::bit_cast<V>(static_cast<uint32_t>(word));
+    else if constexpr (sizeof(V) == sizeof(uint16_t))
+        return std::bit_cast<V>(static_cast<uint16_t>(word));
+    else
+        return std::bit_cast<V>(static_cast<uint8_t>(word));
+}
+
+/**
+ * @brief An assembled thunk (see thumb_asm::assemble_adapter), stored as the code it will execute.
+ * 
+ * The code is padded to a whole number of words and its literals, followed by the target address,
+ * must immediately follow this member in the containing trampoline.
+ * Every instantiation runs its opcodes through thumb_model against random registers and literals.
+ * 
+ * @tparam Spec Provides sources (array of thumb_asm::source, one per outgoing register),
+ * incoming (number of callback arguments), and literals (number of words between the code and the target).
+ */
+template<typename Spec> struct adapter_code
+{
+    static constexpr size_t count = std::size(Spec::sources);
+    /**
+     * @brief Halfwords of code, padded so the literals stay word aligned.
+     */
+    static constexpr size_t length = thumb_asm::adapter_length(std::data(Spec::sources), count, Spec::incoming);
+    static constexpr size_t literals_at = length * 2;
+    static constexpr size_t target_at = literals_at + Spec::literals * sizeof(uint32_t);
+
+    static constexpr thumb_asm::code<length> opcodes = []
+    {
+        thumb_asm::code<length> c;
+        thumb_asm::assemble_adapter(c, std::data(Spec::sources), count, Spec::incoming, literals_at, target_at);
+        return c;
+    }();
+    static_assert(opcodes.size == length && !opcodes.failed, "Thunk failed to assemble.");
+    static_assert(thumb_model::fuzz_adapter<Spec::literals>(opcodes.op, std::data(Spec::sources), count, 64), "Thunk differs from a direct call to its target.");
+
+    /**
+     * @brief Cortex-M0+ cycles from the first instruction up to and including the branch to the target.
+     */
+    static constexpr unsigned cycles = []
+    {
+        uint32_t literals[Spec::literals] = { };
+        return thumb_model::run_adapter(opcodes.op, literals, 1, 0, { }).cycles;
+    }();
+
+    uint16_t volatile __attribute__((aligned(4))) code[length];
+
+    constexpr adapter_code() : adapter_code(std::make_index_sequence<length>()) { }
+    template<size_t... I> constexpr adapter_code(std::index_sequence<I...>) : code { opcodes.op[I]... } { }
+    /**
+     * @brief Same code, except the first instruction is entry instead (typically a branch somewhere else until it's patched back).
+     */
+    constexpr adapter_code(uint16_t entry) : adapter_code(entry, std::make_index_sequence<length>()) { }
+    template<size_t... I> constexpr adapter_code(uint16_t entry, std::index_sequence<I...>) : code { (I ? opcodes.op[I] : entry)... } { }
+};
+
+/**
+ * @brief Where a pointer-to-member's code is, or 0 for a virtual function, whose code isn't known until it's called.
+ *
+ * A pointer-to-member is two words, the function (or vtable offset) and an adjustment. Virtual is marked by the
+ * low bit of the adjustment under the ARM C++ ABI and by the low bit of the function everywhere else.
+ */
+template<typename M> requires std::is_member_function_pointer_v<M> uintptr_t method_code_address(M method)
+{
+    std::array<uintptr_t, sizeof(M) / sizeof(uintptr_t)> words = std::bit_cast<decltype(words)>(method);
+#ifdef __thumb__
+    if (words[1] & 1)
+        return 0;
+#else
+    if (words[0] & 1)
+        return 0;
+#endif /* __thumb__ */
+    return words[0];
+}
+
+/**
+ * @brief Sources for adapter_code: bound literals 0 to Literals - 1 in the first registers, then Incoming arguments.
+ */
+template<size_t Literals, size_t Incoming> struct literals_then_arguments
+{
+    static constexpr size_t incoming = Incoming;
+    static constexpr size_t literals = Literals;
+    static constexpr auto sources = []
+    {
+        std::array<thumb_asm::source, Literals + Incoming> s { };
+        for (size_t i = 0; i < Literals; i++)
+            s[i] = thumb_asm::bound(i);
+        for (size_t i = 0; i < Incoming; i++)
+            s[Literals + i] = thumb_asm::arg(i);
+        return s;
+    }();
+};
+
 /**
  * @brief Adapts a non-static class method for use with a C callback.
  * 
@@ -44,8 +204,8 @@ template<int Count, typename ... Args> concept NotTooManyArgs = sizeof...(Args)
  * @tparam Args List of zero to three additional parameters to the function.
  */
 template<typename T, typename R, FitsInRegister... Args>
-requires ((sizeof(R) <= 8) || VoidReturn<R>) && NotTooManyArgs<3, Args...>
-struct __attribute__((packed, aligned(4))) c_trampoline
+requires RegisterReturn<R> && NotTooManyArgs<3, Args...>
+struct C_TRAMPOLINE_LAYOUT(4) c_trampoline
 {
         /**
          * @brief Type of a member function pointer.
@@ -63,14 +223,42 @@ struct __attribute__((packed, aligned(4))) c_trampoline
         /**
          * @brief Only reasonable constructor.
          * 
+         * constexpr, so a global trampoline (or one inside a global with a constexpr constructor) can be
+         * declared constinit and is then fully built in .data by the startup copy, before any constructors run.
+         * 
          * @param self Object to bind this wrapper to.
          * @param method Member function pointer you want adapted for use with C.
          */
-        c_trampoline(T& self, member_function_pointer method)
+        constexpr c_trampoline(T& self, member_function_pointer method)
             : self { &self }, method { method }
         {
-            // and that's all
+#ifdef __thumb__
+            // The code was assembled (and modelled) assuming this layout.
+            static_assert(offsetof(c_trampoline, self) == AsmCode<sizeof...(Args)>::literals_at);
+            static_assert(offsetof(c_trampoline, method) == AsmCode<sizeof...(Args)>::literals_at + sizeof(T*));
+#endif /* __thumb__ */
+        }
+
+#ifdef C_TRAMPOLINE_CHECKED
+        /**
+         * @brief Poisons the thunk so a late call faults in a way c_trampoline_checked::poisoned_identity() recognizes.
+         */
+        ~c_trampoline()
+        {
+            c_trampoline_checked::unlink(checked);
+            c_trampoline_checked::poison_code(asm_code.code, identity());
+        }
+        /**
+         * @brief True if the thunk, the canary, and self all still look the way the constructor left them.
+         */
+        bool intact() const
+        {
+            for (size_t i = 0; i < std::size(asm_code.code); i++)
+                if (asm_code.code[i] != AsmCode<sizeof...(Args)>::opcodes.op[i])
+                    return false;
+            return canary == c_trampoline_checked::canary && self;
         }
+#endif /* C_TRAMPOLINE_CHECKED */
 
         // Copy and assignment must correctly change self to point to the correct object,
         // which the containing object must handle.
@@ -82,14 +270,22 @@ struct __attribute__((packed, aligned(4))) c_trampoline
          */
         operator function_pointer() const
         {
-            return reinterpret_cast<function_pointer>((uint8_t*)&asm_code + 1); // Plus one to stay in Thumb node.
+            return get_callback();
         }
         /**
          * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
          */
         function_pointer get_callback() const
         {
-            return reinterpret_cast<function_pointer>((uint8_t*)&asm_code + 1);
+#ifdef C_TRAMPOLINE_CHECKED
+            // Here rather than in the constructor, which doesn't run at all for a constant-initialized global.
+            c_trampoline_checked::link(checked);
+#endif /* C_TRAMPOLINE_CHECKED */
+#ifdef __thumb__
+            return reinterpret_cast<function_pointer>((uint8_t*)&asm_code + 1); // Plus one to stay in Thumb node.
+#else
+            return host_slot.get(const_cast<c_trampoline*>(this), &host_invoke);
+#endif /* __thumb__ */
         }
         
         /**
@@ -113,57 +309,11 @@ struct __attribute__((packed, aligned(4))) c_trampoline
         /**
          * @brief Conditionally adjusts the size of the asm_code block depending on the number of parameters.
          * 
+         * self goes in r0 and the C arguments shift up one register to make room.
+         * 
          * @tparam Count Number of arguments
          */
-        template<int Count> struct AsmCode;
-        template<int Count> requires (Count == 0) struct AsmCode<Count>
-        {
-            uint16_t volatile __attribute__((aligned(4))) code[4] =
-            {
-                        // ; PC is measured from the address of the start of the next instruction pair.
-                0x4801, // ldr r0, [pc, #4]     ; self
-                0x4B02, // ldr r3, [pc, #8]     ; method (note that both LDRs are in the SAME pair)
-                0x4718, // bx  r3
-                0xBF00, // nop
-            };
-        };
-        template<int Count> requires (Count == 1) struct AsmCode<Count>
-        {
-            uint16_t volatile __attribute__((aligned(4))) code[4] =
-            {
-                0x4601, // mov r1, r0
-                0x4801, // ldr r0, [pc, #4]     ; self
-                0x4B01, // ldr r3, [pc, #4]     ; method (note that both LDRs are in DIFFERENT pairs)
-                0x4718, // bx  r3
-            };
-        };
-        template<int Count> requires (Count == 2) struct AsmCode<Count>
-        {
-            uint16_t volatile __attribute__((aligned(4))) code[6] =
-            {
-                0x460A, // mov r2, r1
-                0x4601, // mov r1, r0
-                0x4801, // ldr r0, [pc, #4]     ; self
-                0x4B02, // ldr r3, [pc, #8]     ; method (note that both LDRs are in the SAME pair)
-                0x4718, // bx  r3
-                0xBF00, // nop
-            };
-        };
-        template<int Count> requires (Count == 3) struct AsmCode<Count>
-        {
-            uint16_t volatile __attribute__((aligned(4))) code[8] =
-            {
-                0x4613, // mov r3, r2
-                0x460A, // mov r2, r1
-                0x4601, // mov r1, r0
-                        // ; r12 also need not be preserved
-                0x4803, // ldr r0, [pc, #12]    ; method
-                0x4684, // mov r12, r0
-                0x4801, // ldr r0, [pc, #4]     ; self
-                0x4760, // bx r12
-                0xBF00, // nop
-            };
-        };
+        template<int Count> using AsmCode = adapter_code<literals_then_arguments<1, Count>>;
         AsmCode<sizeof...(Args)> asm_code;
         /* Alternatively, we could derive the this pointer from PC, 
          * but that requires introducing the offset as a parameter to the template.
@@ -177,6 +327,133 @@ struct __attribute__((packed, aligned(4))) c_trampoline
          * @brief This is the actual member function pointer being wrapped.
          */
         member_function_pointer method; // DO NOT change the order of this member or asm_code will be invalid!
+#ifdef C_TRAMPOLINE_CHECKED
+        uint32_t canary = c_trampoline_checked::canary;
+        mutable c_trampoline_checked::node checked { nullptr, nullptr, &check };
+        /**
+         * @brief Address of the method's code (the first word of the pointer-to-member), which is what shows up in a map file.
+         */
+        uintptr_t identity() const
+        {
+            return std::bit_cast<std::array<uintptr_t, sizeof(member_function_pointer) / sizeof(uintptr_t)>>(method)[0];
+        }
+        static c_trampoline_checked::report check(const c_trampoline_checked::node* n)
+        {
+            const c_trampoline& t = *reinterpret_cast<const c_trampoline*>(reinterpret_cast<const char*>(n) - offsetof(c_trampoline, checked));
+            return { t.intact(), &t, t.identity() };
+        }
+#endif /* C_TRAMPOLINE_CHECKED */
+#ifndef __thumb__
+        /**
+         * @brief Stands in for asm_code when building for the host, see c_trampoline_host.hpp.
+         */
+        c_trampoline_host::slot<R, Args...> host_slot;
+        static R host_invoke(void* context, Args... args)
+        {
+            c_trampoline& trampoline = *static_cast<c_trampoline*>(context);
+            return (trampoline.self->*trampoline.method)(args...);
+        }
+#endif /* __thumb__ */
+
+        /**
+         * @brief Result of running asm_code through the ARMv6-M model with marker values for self, method, and the arguments.
+         */
+        static constexpr thumb_model::outcome model = thumb_model::run_trampoline(AsmCode<sizeof...(Args)>::opcodes.op);
+        static_assert(thumb_model::forwards_to_method(model, sizeof...(Args)), "asm_code does not pass self and the arguments through to method.");
+        static_assert(thumb_model::fuzz_trampoline(AsmCode<sizeof...(Args)>::opcodes.op, sizeof...(Args), 64), "asm_code differs from a direct call to method.");
+        static_assert(thumb_model::set_method_race(AsmCode<sizeof...(Args)>::opcodes.op).clean(), "A call racing set_method can see half of it.");
+
+    public:
+        /**
+         * @brief Cortex-M0+ cycles spent in the trampoline, from the first instruction up to and including the branch to method.
+         */
+        static constexpr unsigned thunk_cycles = model.cycles;
+};
+
+/**
+ * @brief Lets a local c_trampoline be declared without spelling out R and Args, e.g. `c_trampoline t { *this, &foo::on_irq };`
+ */
+template<typename T, typename R, typename... Args> c_trampoline(T&, R (T::*)(Args...)) -> c_trampoline<T, R, Args...>;
+
+/**
+ * @brief Splits a C callback type, either a function or a pointer to one, into its return and argument types.
+ */
+template<typename Callback> struct callback_traits;
+template<typename R, typename... Args> struct callback_traits<R(Args...)>
+{
+    typedef R return_type;
+    typedef R (*function_pointer)(Args...);
+    template<typename T> using trampoline = c_trampoline<T, R, Args...>;
+    template<typename T> using member_function_pointer = R (T::*)(Args...);
+};
+template<typename R, typename... Args> struct callback_traits<R(Args...) noexcept> : callback_traits<R(Args...)> { };
+template<typename Callback> struct callback_traits<Callback*> : callback_traits<Callback> { };
+
+/**
+ * @brief The c_trampoline serving a given C callback type, e.g. `trampoline_for<foo, irq_handler_t>`.
+ *
+ * Works for any callback typedef from any library, so no hand-written alias is needed.
+ */
+template<typename T, typename Callback> using trampoline_for = typename callback_traits<Callback>::template trampoline<T>;
+
+/**
+ * @brief Type of parameter Index of a C function (say, the one that registers the callback).
+ */
+template<typename Function, size_t Index> struct parameter_of;
+template<typename R, typename... Args, size_t Index> struct parameter_of<R (*)(Args...), Index>
+{
+    static_assert(Index < sizeof...(Args), "Function doesn't have that many parameters.");
+    typedef std::tuple_element_t<Index, std::tuple<Args...>> type;
+};
+
+/**
+ * @brief Index of the only function pointer parameter of a registration function, which is then taken to be the callback.
+ */
+template<typename Function> struct callback_parameter_of;
+template<typename R, typename... Args> struct callback_parameter_of<R (*)(Args...)>
+{
+    static constexpr size_t count = (0 + ... + std::is_function_v<std::remove_pointer_t<Args>>);
+    static_assert(count == 1, "Registration function doesn't take exactly one callback; use parameter_of to say which one.");
+    static constexpr size_t index = []
+    {
+        constexpr bool callback[] = { std::is_function_v<std::remove_pointer_t<Args>>... };
+        size_t i = 0;
+        while (!callback[i])
+            i++;
+        return i;
+    }();
 };
 
+/**
+ * @brief The c_trampoline that can be passed to a registration function, e.g. `trampoline_for_registration<foo, &irq_set_exclusive_handler>`.
+ *
+ * @tparam Register Address of the function that takes the callback.
+ * @tparam Index Which of its parameters is the callback; by default, the only one that's a function pointer.
+ */
+template<typename T, auto Register, size_t Index = callback_parameter_of<decltype(Register)>::index>
+using trampoline_for_registration = trampoline_for<T, typename parameter_of<decltype(Register), Index>::type>;
+
+/**
+ * @brief Passes method through unchanged, but first checks it takes exactly what Callback passes and returns what it returns.
+ *
+ * Mostly for MAKE_TRAMPOLINE_FOR, so a mismatch is reported as such rather than as a failed conversion.
+ */
+template<typename Callback, typename T, typename M>
+constexpr typename callback_traits<Callback>::template member_function_pointer<T> checked_method(M T::* method)
+{
+    static_assert(std::is_convertible_v<M T::*, typename callback_traits<Callback>::template member_function_pointer<T>>,
+        "Method's return and parameter types don't match the callback's.");
+    return method;
+}
+
+/**
+ * @brief Like MAKE_TRAMPOLINE, but for any C callback type rather than a fixed list.
+ *
+ * @param CALLBACK Callback type, e.g. irq_handler_t, or a function type.
+ * @param CLASS Type of the current class.
+ * @param METHOD Name of method that does the real work.
+ * @param HANDLER Name of handler variable that will be passed to the C API routines.
+ */
+#define MAKE_TRAMPOLINE_FOR(CALLBACK, CLASS, METHOD, HANDLER) trampoline_for<CLASS, CALLBACK> HANDLER { *this, checked_method<CALLBACK>(&CLASS::METHOD) }
+
 #endif /* C_TRAMPOLINE_H */
@@ -0,0 +1,129 @@
+#ifndef C_TRAMPOLINE_CHECKED_H
+#define C_TRAMPOLINE_CHECKED_H
+#include <stdint.h>
+#include <stddef.h>
+#include "thumb_asm.hpp"
+
+/**
+ * @brief Support for C_TRAMPOLINE_CHECKED builds, where c_trampolines can say who they are when things go wrong.
+ *
+ * In a checked build a c_trampoline's destructor overwrites its thunk with two `udf #poison` followed by
+ * the address of the method it used to call, so calling a dead trampoline faults right at the thunk and the
+ * HardFault handler can hand poisoned_identity() the stacked pc to find out which handler it was.
+ * Each trampoline also carries a canary word after its literals and joins a list of live trampolines
+ * that scan() checks, so corruption shows up in a periodic check rather than as a fault in some random place.
+ *
+ * A trampoline joins the list the first time its callback is handed out, so one built by constant
+ * initialization (a plain global, or constinit) is on it too, from then on, without a constructor having run.
+ * The list isn't locked: get callbacks and destroy trampolines from one context, and don't scan() from an
+ * interrupt that might preempt either.
+ */
+namespace c_trampoline_checked
+{
+    /**
+     * @brief Immediate of the udf a destroyed thunk is filled with.
+     */
+    constexpr unsigned poison = 0xD5;
+    /**
+     * @brief Value every live trampoline's canary holds.
+     */
+    constexpr uint32_t canary = 0xCA7A4A11;
+
+    /**
+     * @brief What scan() finds out about a trampoline.
+     */
+    struct report
+    {
+        bool intact;
+        const void* trampoline;
+        /**
+         * @brief Address of the method it calls, as far as its (possibly corrupt) literals say.
+         */
+        uintptr_t identity;
+    };
+
+    /**
+     * @brief Entry in the list of live trampolines.
+     */
+    struct node
+    {
+        node* next = nullptr;
+        node* prev = nullptr;
+        report (*check)(const node*) = nullptr;
+    };
+    inline node* live = nullptr;
+
+    /**
+     * @brief Adds n to the list, unless it's already on it.
+     */
+    inline void link(node& n)
+    {
+        if (n.prev || live == &n)
+            return;
+        n.next = live;
+        if (live)
+            live->prev = &n;
+        live = &n;
+    }
+    inline void unlink(node& n)
+    {
+        if (n.prev)
+            n.prev->next = n.next;
+        else if (live == &n)
+            live = n.next;
+        if (n.next)
+            n.next->prev = n.prev;
+        n.next = n.prev = nullptr;
+    }
+
+    /**
+     * @brief Turns a thunk into a trap that names identity.
+     *
+     * The first halfword goes first so new calls fault straight away.
+     */
+    template<size_t N> void poison_code(uint16_t volatile (&code)[N], uintptr_t identity)
+    {
+        static_assert(N >= 4, "Thunk too short to hold a poisoned identity.");
+        code[0] = thumb_asm::udf(poison);
+        code[2] = uint16_t(identity);
+        code[3] = uint16_t(identity >> 16);
+        code[1] = thumb_asm::udf(poison);
+    }
+
+    /**
+     * @brief Checks every live trampoline.
+     *
+     * @param damaged Called with each one that fails its check; may be null.
+     * @return Number that failed.
+     */
+    inline size_t scan(void (*damaged)(const report&) = nullptr)
+    {
+        size_t failed = 0;
+        for (const node* n = live; n; n = n->next)
+        {
+            report r = n->check(n);
+            if (r.intact)
+                continue;
+            failed++;
+            if (damaged)
+                damaged(r);
+        }
+        return failed;
+    }
+
+    /**
+     * @brief Recognizes a fault inside a destroyed trampoline.
+     *
+     * @param pc Address of the faulting instruction, i.e. the pc stacked on entry to HardFault.
+     * @return Address of the method the trampoline used to call, or 0 if pc isn't in a poisoned thunk.
+     */
+    inline uintptr_t poisoned_identity(uintptr_t pc)
+    {
+        const uint16_t volatile* at = reinterpret_cast<const uint16_t volatile*>(pc & ~uintptr_t { 1 });
+        if (at[0] != thumb_asm::udf(poison) || at[1] != thumb_asm::udf(poison))
+            return 0;
+        return at[2] | uintptr_t { at[3] } << 16;
+    }
+}
+
+#endif /* C_TRAMPOLINE_CHECKED_H */
@@ -0,0 +1,125 @@
+#ifndef C_TRAMPOLINE_HOST_H
+#define C_TRAMPOLINE_HOST_H
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <array>
+#include <atomic>
+#include <utility>
+
+/**
+ * @brief Host (non-Thumb) stand-in for the generated thunks.
+ *
+ * Data can't be executed on the host, so instead each signature gets a fixed table of ordinary functions.
+ * Slot I's function looks up entry I and forwards to it, which is the static slot table adapter with
+ * the bookkeeping done for you.
+ * This exists so drivers written against c_trampoline can be built and run on Linux against host/pico_mock.hpp;
+ * it says nothing about how the real thunks perform.
+ */
+namespace c_trampoline_host
+{
+#ifndef C_TRAMPOLINE_HOST_SLOTS
+/**
+ * @brief Number of live trampolines allowed per signature on the host.
+ */
+#define C_TRAMPOLINE_HOST_SLOTS 64
+#endif /* C_TRAMPOLINE_HOST_SLOTS */
+
+    /**
+     * @brief Shared table of slots for every trampoline with the C signature R(Args...).
+     */
+    template<typename R, typename... Args>
+    struct pool
+    {
+        typedef R (*function_pointer)(Args...);
+        typedef R (*invoker)(void* context, Args...);
+
+        struct entry
+        {
+            std::atomic<void*> context { nullptr };
+            invoker invoke = nullptr;
+        };
+        static inline entry table[C_TRAMPOLINE_HOST_SLOTS];
+
+        template<size_t I> static R call(Args... args)
+        {
+            entry& e = table[I];
+            return e.invoke(e.context.load(std::memory_order_acquire), args...);
+        }
+
+        template<size_t... I> static constexpr auto make_callbacks(std::index_sequence<I...>)
+        {
+            return std::array<function_pointer, sizeof...(I)> { &call<I>... };
+        }
+        static constexpr std::array<function_pointer, C_TRAMPOLINE_HOST_SLOTS> callbacks = make_callbacks(std::make_index_sequence<C_TRAMPOLINE_HOST_SLOTS>());
+
+        /**
+         * @brief Takes a free slot and points it at context.
+         *
+         * Running out of slots is a configuration error, so this aborts rather than returning something to check.
+         */
+        static int claim(void* context, invoker invoke)
+        {
+            for (int i = 0; i < C_TRAMPOLINE_HOST_SLOTS; i++)
+            {
+                void* expected = nullptr;
+                if (table[i].context.compare_exchange_strong(expected, context, std::memory_order_acq_rel))
+                {
+                    // Nobody can call slot i until its callback pointer has been handed out, which is after this returns.
+                    table[i].invoke = invoke;
+                    return i;
+                }
+            }
+            fputs("c_trampoline_host: out of slots, raise C_TRAMPOLINE_HOST_SLOTS\n", stderr);
+            abort();
+        }
+        static void release(int i)
+        {
+            table[i].context.store(nullptr, std::memory_order_release);
+        }
+    };
+
+    /**
+     * @brief Per-trampoline handle on a pool slot.
+     *
+     * The slot is claimed the first time a callback pointer is requested, so constructing a trampoline
+     * stays cheap (and constant-initializable), and released when the trampoline is destroyed.
+     * Threads asking for the first callback at once agree on one slot; the losers give theirs back.
+     */
+    template<typename R, typename... Args>
+    class slot
+    {
+        public:
+            constexpr slot() = default;
+            slot(const slot&) = delete;
+            slot& operator=(const slot&) = delete;
+            ~slot()
+            {
+                int i = index.load(std::memory_order_relaxed);
+                if (i >= 0)
+                    pool<R, Args...>::release(i);
+            }
+
+            /**
+             * @brief Returns the callback for this slot, claiming one for context on first use.
+             */
+            typename pool<R, Args...>::function_pointer get(void* context, typename pool<R, Args...>::invoker invoke) const
+            {
+                int i = index.load(std::memory_order_acquire);
+                if (i < 0)
+                {
+                    int claimed = pool<R, Args...>::claim(context, invoke);
+                    if (index.compare_exchange_strong(i, claimed, std::memory_order_acq_rel))
+                        i = claimed;
+                    else
+                        pool<R, Args...>::release(claimed);
+                }
+                return pool<R, Args...>::callbacks[i];
+            }
+
+        private:
+            mutable std::atomic<int> index { -1 };
+    };
+}
+
+#endif /* C_TRAMPOLINE_HOST_H */
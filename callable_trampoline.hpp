@@ -0,0 +1,87 @@
+#ifndef CALLABLE_TRAMPOLINE_H
+#define CALLABLE_TRAMPOLINE_H
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "function_trampoline.hpp"
+
+/**
+ * @brief Turns a lambda or other functor, captures and all, into a C function pointer.
+ *
+ * The functor is moved into a buffer inside the trampoline, so there's no heap and no global.
+ * A function_trampoline passes the buffer's address to a per-type invoker that calls the functor,
+ * so a call costs the thunk plus one direct branch.
+ *
+ * @code
+ * callable_trampoline<void(uint32_t, uint32_t)> on_edge { [this, pin](uint32_t gpio, uint32_t events) { ... } };
+ * gpio_set_irq_enabled_with_callback(pin, GPIO_IRQ_EDGE_RISE, true, on_edge);
+ * @endcode
+ *
+ * @warning Same caveats as c_trampoline.
+ *
+ * @tparam Signature C callback signature, R(Args...) with at most three arguments.
+ * @tparam Capacity Bytes of inline storage; a functor that doesn't fit is a compile error, not an allocation.
+ */
+template<typename Signature, size_t Capacity = 4 * sizeof(void*)> struct callable_trampoline;
+
+template<typename R, FitsInRegister... Args, size_t Capacity>
+requires RegisterReturn<R> && NotTooManyArgs<3, Args...>
+struct C_TRAMPOLINE_LAYOUT(8) callable_trampoline<R(Args...), Capacity>
+{
+        typedef R (*function_pointer)(Args...);
+
+        /**
+         * @param callable Anything callable as R(Args...); it is moved (or copied) into the trampoline.
+         */
+        template<typename F>
+        requires std::is_invocable_r_v<R, std::decay_t<F>&, Args...> && (!std::is_same_v<std::decay_t<F>, callable_trampoline>)
+        callable_trampoline(F&& callable)
+            : thunk { &invoke<std::decay_t<F>>, &storage },
+              destroy { std::is_trivially_destructible_v<std::decay_t<F>> ? nullptr : &destroy_as<std::decay_t<F>> }
+        {
+            static_assert(sizeof(std::decay_t<F>) <= Capacity, "Callable doesn't fit; raise Capacity.");
+            static_assert(alignof(std::decay_t<F>) <= alignof(max_align_t) && alignof(std::decay_t<F>) <= 8, "Callable is over-aligned for the inline storage.");
+            new (&storage) std::decay_t<F>(std::forward<F>(callable));
+        }
+
+        // The thunk points into this object, so it can't be copied or moved.
+        callable_trampoline(const callable_trampoline&) = delete;
+        callable_trampoline& operator=(const callable_trampoline&) = delete;
+
+        ~callable_trampoline()
+        {
+            if (destroy)
+                destroy(&storage);
+        }
+
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        operator function_pointer() const
+        {
+            return get_callback();
+        }
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        function_pointer get_callback() const
+        {
+            return thunk.get_callback();
+        }
+
+    private:
+        template<typename F> static R invoke(void* storage, Args... args)
+        {
+            return (*static_cast<F*>(storage))(args...);
+        }
+        template<typename F> static void destroy_as(void* storage)
+        {
+            static_cast<F*>(storage)->~F();
+        }
+
+        function_trampoline<R(Args...)> thunk;
+        void (* const destroy)(void*);
+        alignas(8) unsigned char storage[Capacity];
+};
+
+#endif /* CALLABLE_TRAMPOLINE_H */
@@ -0,0 +1,86 @@
+#ifndef COMPARATOR_TRAMPOLINE_H
+#define COMPARATOR_TRAMPOLINE_H
+#include <stdlib.h>
+#include <type_traits>
+#include "function_trampoline.hpp"
+
+/**
+ * @brief A qsort/bsearch comparator that carries its own context, from an object comparing typed records.
+ *
+ * qsort and bsearch take a bare `int (*)(const void*, const void*)`, so a comparator that needs a collation table
+ * or a choice of sort key usually gets it from a global, or a thread_local so parallel sorts don't trip
+ * over each other. Here the comparison is an object, and the comparator is a trampoline bound to it, so any
+ * number of sorts with different settings can run at once on any threads, each with its own:
+ * @code
+ * struct by_name
+ * {
+ *     const collation& rules;
+ *     int operator()(const employee& a, const employee& b) const { return rules.compare(a.name, b.name); }
+ * };
+ * by_name order { german };
+ * comparator_trampoline<employee, by_name> comparator { order };
+ * comparator.sort(staff, count);                                 // or qsort(staff, count, sizeof(employee), comparator)
+ * const employee* found = comparator.search(key, staff, count);
+ * @endcode
+ *
+ * It's a function_trampoline underneath, so on the host it takes a c_trampoline_host slot while a callback is out.
+ * Where the C library has qsort_r (or qsort_s) and nothing else needs the plain pointer, that's cheaper by an
+ * indirect call per comparison; this is for code that's handed a plain comparator slot.
+ *
+ * @tparam Record Type of the array elements.
+ * @tparam Compare Callable as int(const Record&, const Record&), returning less than, equal to, or greater than zero.
+ */
+template<typename Record, typename Compare>
+requires std::is_invocable_r_v<int, Compare&, const Record&, const Record&>
+struct comparator_trampoline
+{
+        typedef int (*function_pointer)(const void*, const void*);
+
+        /**
+         * @param compare Comparison to bind to; must outlive this.
+         */
+        comparator_trampoline(Compare& compare) : thunk { &compare_records, &compare } { }
+
+        comparator_trampoline(const comparator_trampoline&) = delete;
+        comparator_trampoline& operator=(const comparator_trampoline&) = delete;
+
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit comparator.
+         */
+        operator function_pointer() const
+        {
+            return get_callback();
+        }
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit comparator.
+         */
+        function_pointer get_callback() const
+        {
+            return thunk.get_callback();
+        }
+
+        /**
+         * @brief qsort with this comparator.
+         */
+        void sort(Record* records, size_t count) const
+        {
+            qsort(records, count, sizeof(Record), get_callback());
+        }
+        /**
+         * @brief bsearch with this comparator, over records sorted by it.
+         */
+        const Record* search(const Record& key, const Record* records, size_t count) const
+        {
+            return static_cast<const Record*>(bsearch(&key, records, count, sizeof(Record), get_callback()));
+        }
+
+    private:
+        static int compare_records(Compare* compare, const void* a, const void* b)
+        {
+            return (*compare)(*static_cast<const Record*>(a), *static_cast<const Record*>(b));
+        }
+
+        function_trampoline<int(const void*, const void*), Compare> thunk;
+};
+
+#endif /* COMPARATOR_TRAMPOLINE_H */
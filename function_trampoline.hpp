@@ -0,0 +1,115 @@
+#ifndef FUNCTION_TRAMPOLINE_H
+#define FUNCTION_TRAMPOLINE_H
+#include "c_trampoline.hpp"
+
+/**
+ * @brief Adapts a plain C-style handler that takes a context pointer first for use with a callback that doesn't.
+ *
+ * Same thunk as c_trampoline, but no class is involved: the context goes in r0 and the handler is
+ * an ordinary function, so legacy `void handler(void* ctx, uint32_t x)` code can hook SDK callbacks
+ * lacking userdata without growing a wrapper class.
+ *
+ * @code
+ * void on_alarm(void* ctx, uint32_t alarm_num);
+ * function_trampoline<void(uint32_t)> alarm_handler { &on_alarm, &my_state };
+ * hardware_alarm_set_callback(0, alarm_handler);
+ * @endcode
+ *
+ * @warning Same caveats as c_trampoline.
+ *
+ * @tparam Signature C callback signature, R(Args...) with at most three arguments.
+ * @tparam Context Type the context points to; void for the classic C pattern.
+ */
+template<typename Signature, typename Context = void> struct function_trampoline;
+
+template<typename R, FitsInRegister... Args, typename Context>
+requires RegisterReturn<R> && NotTooManyArgs<3, Args...>
+struct C_TRAMPOLINE_LAYOUT(4) function_trampoline<R(Args...), Context>
+{
+        typedef R (*function_pointer)(Args...);
+        /**
+         * @brief Type of the handler being adapted: the callback's signature with the context in front.
+         */
+        typedef R (*handler_pointer)(Context*, Args...);
+
+        /**
+         * @param handler Function to call.
+         * @param context Passed to handler as its first argument on every call.
+         */
+        constexpr function_trampoline(handler_pointer handler, Context* context)
+            : context { context }, handler { handler }
+        {
+#ifdef __thumb__
+            static_assert(offsetof(function_trampoline, context) == Code::literals_at);
+            static_assert(offsetof(function_trampoline, handler) == Code::literals_at + sizeof(Context*));
+#endif /* __thumb__ */
+        }
+
+        function_trampoline(const function_trampoline&) = delete;
+        function_trampoline& operator=(const function_trampoline&) = delete;
+
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        operator function_pointer() const
+        {
+            return get_callback();
+        }
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        function_pointer get_callback() const
+        {
+#ifdef __thumb__
+            return reinterpret_cast<function_pointer>((uint8_t*)&asm_code + 1); // Plus one to stay in Thumb mode.
+#else
+            return host_slot.get(const_cast<function_trampoline*>(this), &host_invoke);
+#endif /* __thumb__ */
+        }
+
+        /**
+         * @brief Changes the handler; a single word store, so a concurrent call sees either the old or the new one.
+         */
+        void set_handler(handler_pointer new_handler)
+        {
+            handler = new_handler;
+        }
+        handler_pointer get_handler() const
+        {
+            return handler;
+        }
+        /**
+         * @brief Changes the context; a single word store.
+         *
+         * Changing the handler and the context one after the other is not atomic as a pair.
+         */
+        void set_context(Context* new_context)
+        {
+            context = new_context;
+        }
+        Context* get_context() const
+        {
+            return context;
+        }
+
+        /**
+         * @brief Cortex-M0+ cycles spent in the trampoline, from the first instruction up to and including the branch to the handler.
+         */
+        static constexpr unsigned thunk_cycles = adapter_code<literals_then_arguments<1, sizeof...(Args)>>::cycles;
+
+    private:
+        typedef adapter_code<literals_then_arguments<1, sizeof...(Args)>> Code;
+        Code asm_code;
+        Context* context; // DO NOT change the order of this member or asm_code will be invalid!
+        handler_pointer handler; // DO NOT change the order of this member or asm_code will be invalid!
+#ifndef __thumb__
+        c_trampoline_host::slot<R, Args...> host_slot;
+        static R host_invoke(void* trampoline, Args... args)
+        {
+            function_trampoline& t = *static_cast<function_trampoline*>(trampoline);
+            return t.handler(t.context, args...);
+        }
+#endif /* __thumb__ */
+};
+
+#endif /* FUNCTION_TRAMPOLINE_H */
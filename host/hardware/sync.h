@@ -0,0 +1,5 @@
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+/* Host stand-in, see host/pico_mock.hpp. */
+#include "../pico_mock.hpp"
+#endif /* _HARDWARE_SYNC_H */
@@ -0,0 +1,5 @@
+#ifndef _PICO_MULTICORE_H
+#define _PICO_MULTICORE_H
+/* Host stand-in, see host/pico_mock.hpp. */
+#include "../pico_mock.hpp"
+#endif /* _PICO_MULTICORE_H */
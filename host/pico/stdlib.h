@@ -0,0 +1,5 @@
+#ifndef _PICO_STDLIB_H
+#define _PICO_STDLIB_H
+/* Host stand-in, see host/pico_mock.hpp. */
+#include "../pico_mock.hpp"
+#endif /* _PICO_STDLIB_H */
@@ -0,0 +1,5 @@
+#ifndef _PICO_TIME_H
+#define _PICO_TIME_H
+/* Host stand-in, see host/pico_mock.hpp. */
+#include "../pico_mock.hpp"
+#endif /* _PICO_TIME_H */
@@ -0,0 +1,962 @@
+#ifndef PICO_MOCK_H
+#define PICO_MOCK_H
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/**
+ * @file
+ * @brief Host stand-in for the parts of the Pico SDK that take callbacks.
+ *
+ * Put the host/ directory on the include path ahead of (instead of) the SDK and drivers written against
+ * hardware/irq.h, hardware/gpio.h, pico/time.h, and friends compile unchanged on Linux, with their
+ * trampolines running through c_trampoline_host.hpp.
+ *
+ * Nothing happens by itself: time only moves when pico_mock::advance_us() (or sleep_us()) is called,
+ * and interrupts are raised with pico_mock::raise_irq(), pico_mock::gpio_event(), and so on.
+ * Delivery follows the NVIC rules for a single core: a pending, enabled IRQ runs immediately if its
+ * priority is strictly higher than whatever is running, otherwise it waits, and the highest priority
+ * pending IRQ goes first.
+ *
+ * Every function here takes the same recursive lock, which plays the part of the core, so load tests can
+ * raise interrupts from as many threads as they like and handlers still run one at a time.
+ *
+ * There's one NVIC, but get_core_num() reports core 1 while SIO_IRQ_PROC1 is being handled (or inside
+ * pico_mock::as_core(1, ...)), which is enough to exercise code that talks between cores over the SIO FIFOs.
+ */
+
+typedef unsigned int uint;
+typedef unsigned int irq_num_t;
+typedef uint64_t absolute_time_t;
+typedef int32_t alarm_id_t;
+typedef void (*irq_handler_t)(void);
+typedef void (*exception_handler_t)(void);
+typedef void (*resus_callback_t)(void);
+typedef void (*rtc_callback_t)(void);
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+typedef void (*hardware_alarm_callback_t)(uint alarm_num);
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void* user_data);
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t* rt);
+
+typedef struct alarm_pool alarm_pool_t;
+struct repeating_timer
+{
+    int64_t delay_us;
+    alarm_pool_t* pool;
+    alarm_id_t alarm_id;
+    repeating_timer_callback_t callback;
+    void* user_data;
+};
+
+typedef struct
+{
+    int16_t year;
+    int8_t month;
+    int8_t day;
+    int8_t dotw;
+    int8_t hour;
+    int8_t min;
+    int8_t sec;
+} datetime_t;
+
+#define TIMER_IRQ_0 0
+#define TIMER_IRQ_1 1
+#define TIMER_IRQ_2 2
+#define TIMER_IRQ_3 3
+#define PWM_IRQ_WRAP 4
+#define USBCTRL_IRQ 5
+#define XIP_IRQ 6
+#define PIO0_IRQ_0 7
+#define PIO0_IRQ_1 8
+#define PIO1_IRQ_0 9
+#define PIO1_IRQ_1 10
+#define DMA_IRQ_0 11
+#define DMA_IRQ_1 12
+#define IO_IRQ_BANK0 13
+#define IO_IRQ_QSPI 14
+#define SIO_IRQ_PROC0 15
+#define SIO_IRQ_PROC1 16
+#define CLOCKS_IRQ 17
+#define SPI0_IRQ 18
+#define SPI1_IRQ 19
+#define UART0_IRQ 20
+#define UART1_IRQ 21
+#define ADC_IRQ_FIFO 22
+#define I2C0_IRQ 23
+#define I2C1_IRQ 24
+#define RTC_IRQ 25
+#define FIRST_USER_IRQ 26
+#define NUM_USER_IRQS 6
+#define NUM_IRQS 32
+
+#define NUM_TIMERS 4
+#define NUM_BANK0_GPIOS 30
+#define PICO_DEFAULT_IRQ_PRIORITY 0x80
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+
+enum gpio_irq_level
+{
+    GPIO_IRQ_LEVEL_LOW = 0x1u,
+    GPIO_IRQ_LEVEL_HIGH = 0x2u,
+    GPIO_IRQ_EDGE_FALL = 0x4u,
+    GPIO_IRQ_EDGE_RISE = 0x8u,
+};
+
+enum exception_number
+{
+    NMI_EXCEPTION = -14,
+    HARDFAULT_EXCEPTION = -13,
+    SVCALL_EXCEPTION = -5,
+    PENDSV_EXCEPTION = -2,
+    SYSTICK_EXCEPTION = -1,
+};
+
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __force_inline inline __attribute__((always_inline))
+
+namespace pico_mock
+{
+    /**
+     * @brief Everything the mock knows about the simulated chip.
+     */
+    struct chip
+    {
+        std::recursive_mutex core;
+        uint64_t now_us = 0;
+
+        // NVIC
+        irq_handler_t exclusive[NUM_IRQS] = { };
+        std::vector<std::pair<uint8_t, irq_handler_t>> shared[NUM_IRQS];
+        bool enabled[NUM_IRQS] = { };
+        bool pending[NUM_IRQS] = { };
+        uint8_t priority[NUM_IRQS] = { };
+        bool primask = false;
+        unsigned running_priority = 0x100; // thread mode
+        uint current_exception = 0; // what IPSR would say: 0 in thread mode, 16 + n in IRQ n
+        bool user_irq_claimed[NUM_USER_IRQS] = { };
+
+        // System exceptions, indexed by exception_number + 16
+        exception_handler_t exceptions[16] = { };
+
+        // IO bank 0
+        gpio_irq_callback_t gpio_callback = nullptr;
+        uint32_t gpio_enabled_events[NUM_BANK0_GPIOS] = { };
+        uint32_t gpio_pending_events[NUM_BANK0_GPIOS] = { };
+
+        // Hardware alarms
+        bool hardware_alarm_claimed[NUM_TIMERS] = { };
+        hardware_alarm_callback_t hardware_alarm_callbacks[NUM_TIMERS] = { };
+        uint64_t hardware_alarm_event[NUM_TIMERS] = { };
+
+        // Alarm pool and anything else that happens at a time
+        struct event
+        {
+            uint64_t when;
+            std::function<void()> fire;
+        };
+        std::map<uint64_t, event> events; // keyed by id, which is also the alarm_id_t
+        uint64_t next_event = 1;
+        std::vector<std::function<void()>> due_alarms;
+
+        // SIO: the core being simulated, and each core's receive FIFO
+        uint core_num = 0;
+        std::deque<uint32_t> fifo[2];
+
+        resus_callback_t resus_callback = nullptr;
+        rtc_callback_t rtc_callback = nullptr;
+
+        chip()
+        {
+            for (auto& p : priority)
+                p = PICO_DEFAULT_IRQ_PRIORITY;
+        }
+    };
+
+    inline chip& state()
+    {
+        static chip instance;
+        return instance;
+    }
+
+    typedef std::lock_guard<std::recursive_mutex> on_core;
+
+    /**
+     * @brief Runs every pending IRQ that is allowed to preempt what is currently running, highest priority first.
+     */
+    inline void deliver()
+    {
+        chip& c = state();
+        on_core lock { c.core };
+        while (!c.primask)
+        {
+            int best = -1;
+            for (int i = 0; i < NUM_IRQS; i++)
+                if (c.pending[i] && c.enabled[i] && (c.priority[i] & 0xC0) < c.running_priority
+                    && (best < 0 || (c.priority[i] & 0xC0) < (c.priority[best] & 0xC0)))
+                    best = i;
+            if (best < 0)
+                return;
+            c.pending[best] = false;
+            unsigned preempted = c.running_priority;
+            uint interrupted_exception = c.current_exception;
+            uint interrupted_core = c.core_num;
+            c.running_priority = c.priority[best] & 0xC0;
+            c.current_exception = 16 + best;
+            if (best == SIO_IRQ_PROC0 || best == SIO_IRQ_PROC1)
+                c.core_num = best - SIO_IRQ_PROC0;
+            if (c.exclusive[best])
+                c.exclusive[best]();
+            else
+                for (size_t h = 0; h < c.shared[best].size(); h++)
+                    c.shared[best][h].second();
+            c.core_num = interrupted_core;
+            c.current_exception = interrupted_exception;
+            c.running_priority = preempted;
+        }
+    }
+
+    /**
+     * @brief Marks an IRQ pending as if the peripheral had asserted it.
+     */
+    inline void raise_irq(uint num)
+    {
+        chip& c = state();
+        on_core lock { c.core };
+        c.pending[num] = true;
+        deliver();
+    }
+
+    /**
+     * @brief Invokes a system exception handler (e.g. SVCALL_EXCEPTION) directly.
+     */
+    inline void raise_exception(exception_number num)
+    {
+        chip& c = state();
+        on_core lock { c.core };
+        if (!c.exceptions[num + 16])
+            return;
+        uint interrupted_exception = c.current_exception;
+        c.current_exception = num + 16;
+        c.exceptions[num + 16]();
+        c.current_exception = interrupted_exception;
+    }
+
+    /**
+     * @brief Runs code as if it were IRQ num's handler: at its priority, with __get_current_exception() saying so.
+     *
+     * Anything that became pending meanwhile and now gets a look in runs afterwards.
+     */
+    template<typename F> void as_irq(uint num, F&& code)
+    {
+        chip& c = state();
+        on_core lock { c.core };
+        unsigned preempted = c.running_priority;
+        uint interrupted_exception = c.current_exception;
+        c.running_priority = c.priority[num] & 0xC0;
+        c.current_exception = 16 + num;
+        code();
+        c.current_exception = interrupted_exception;
+        c.running_priority = preempted;
+        deliver();
+    }
+
+    /**
+     * @brief Latches GPIO events on a pin and raises IO_IRQ_BANK0 if any of them are enabled.
+     */
+    inline void gpio_event(uint gpio, uint32_t event_mask)
+    {
+        chip& c = state();
+        on_core lock { c.core };
+        c.gpio_pending_events[gpio] |= event_mask & c.gpio_enabled_events[gpio];
+        if (c.gpio_pending_events[gpio])
+            raise_irq(IO_IRQ_BANK0);
+    }
+
+    /**
+     * @brief Schedules fire to run at an absolute time, returning an id that cancel() accepts.
+     */
+    inline uint64_t schedule(uint64_t when, std::function<void()> fire)
+    {
+        chip& c = state();
+        on_core lock { c.core };
+        uint64_t id = c.next_event++;
+        c.events.emplace(id, chip::event { when, std::move(fire) });
+        return id;
+    }
+
+    inline bool cancel(uint64_t id)
+    {
+        chip& c = state();
+        on_core lock { c.core };
+        return c.events.erase(id) != 0;
+    }
+
+    /**
+     * @brief Moves simulated time forward, firing everything that comes due on the way in time order.
+     */
+    inline void advance_us(uint64_t us)
+    {
+        chip& c = state();
+        on_core lock { c.core };
+        uint64_t end = c.now_us + us;
+        for (;;)
+        {
+            auto next = c.events.end();
+            for (auto it = c.events.begin(); it != c.events.end(); ++it)
+                if (it->second.when <= end && (next == c.events.end() || it->second.when < next->second.when))
+                    next = it;
+            if (next == c.events.end())
+                break;
+            if (next->second.when > c.now_us)
+                c.now_us = next->second.when;
+            std::function<void()> fire = std::move(next->second.fire);
+            c.events.erase(next);
+            fire();
+        }
+        c.now_us = end;
+    }
+
+    /**
+     * @brief Fires the clock resus callback.
+     */
+    inline void clock_resus()
+    {
+        raise_irq(CLOCKS_IRQ);
+    }
+
+    /**
+     * @brief Fires the RTC alarm.
+     */
+    inline void rtc_alarm()
+    {
+        raise_irq(RTC_IRQ);
+    }
+
+    /**
+     * @brief Runs code as if on the given core, e.g. to push into core 0's FIFO from core 1.
+     */
+    template<typename F> void as_core(uint core, F&& code)
+    {
+        chip& c = state();
+        on_core lock { c.core };
+        uint previous = c.core_num;
+        c.core_num = core;
+        code();
+        c.core_num = previous;
+    }
+
+    /**
+     * @brief Puts the chip back the way it was at reset, for running several load tests in one process.
+     *
+     * Nothing else may be using the mock while this runs, not even from another thread.
+     */
+    inline void reset()
+    {
+        chip& c = state();
+        c.~chip();
+        new (&c) chip();
+    }
+
+    inline void gpio_bank0_handler()
+    {
+        chip& c = state();
+        for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++)
+        {
+            uint32_t events = c.gpio_pending_events[gpio];
+            if (!events)
+                continue;
+            c.gpio_pending_events[gpio] = 0;
+            if (c.gpio_callback)
+                c.gpio_callback(gpio, events);
+        }
+    }
+
+    template<uint Alarm> void hardware_alarm_handler()
+    {
+        chip& c = state();
+        if (c.hardware_alarm_callbacks[Alarm])
+            c.hardware_alarm_callbacks[Alarm](Alarm);
+    }
+
+    inline void clocks_handler()
+    {
+        if (state().resus_callback)
+            state().resus_callback();
+    }
+
+    inline void rtc_handler()
+    {
+        if (state().rtc_callback)
+            state().rtc_callback();
+    }
+}
+
+/* pico/platform.h */
+
+[[noreturn]] inline void panic(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    fputs("*** PANIC ***\n", stderr);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+    abort();
+}
+
+inline void tight_loop_contents(void) { }
+
+inline uint get_core_num(void)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    return c.core_num;
+}
+
+/**
+ * @brief The active exception number as IPSR has it: 0 in thread mode, 16 + n in IRQ n.
+ */
+inline uint __get_current_exception(void)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    return c.current_exception;
+}
+
+/* hardware/sync.h */
+
+inline uint32_t save_and_disable_interrupts(void)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    uint32_t status = c.primask;
+    c.primask = true;
+    return status;
+}
+
+inline void restore_interrupts(uint32_t status)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    c.primask = status;
+    pico_mock::deliver();
+}
+
+inline void __dmb(void) { std::atomic_thread_fence(std::memory_order_seq_cst); }
+inline void __dsb(void) { std::atomic_thread_fence(std::memory_order_seq_cst); }
+inline void __isb(void) { std::atomic_thread_fence(std::memory_order_seq_cst); }
+inline void __wfi(void) { }
+inline void __wfe(void) { }
+inline void __sev(void) { }
+inline void __nop(void) { }
+
+/* hardware/irq.h */
+
+inline void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    if (c.exclusive[num] || !c.shared[num].empty())
+        panic("Cannot add exclusive handler for IRQ %u: a handler is already installed", num);
+    c.exclusive[num] = handler;
+}
+
+inline irq_handler_t irq_get_exclusive_handler(uint num)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    return c.exclusive[num];
+}
+
+inline void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    if (c.exclusive[num])
+        panic("Cannot add shared handler for IRQ %u: an exclusive handler is installed", num);
+    auto& list = c.shared[num];
+    auto at = list.begin();
+    while (at != list.end() && at->first >= order_priority)
+        ++at;
+    list.insert(at, { order_priority, handler });
+}
+
+inline void irq_remove_handler(uint num, irq_handler_t handler)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    if (c.exclusive[num] == handler)
+        c.exclusive[num] = nullptr;
+    auto& list = c.shared[num];
+    for (auto it = list.begin(); it != list.end(); ++it)
+        if (it->second == handler)
+        {
+            list.erase(it);
+            break;
+        }
+}
+
+inline bool irq_has_shared_handler(uint num)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    return !c.shared[num].empty();
+}
+
+inline void irq_set_enabled(uint num, bool enabled)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    c.enabled[num] = enabled;
+    if (enabled)
+        pico_mock::deliver();
+}
+
+inline bool irq_is_enabled(uint num)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    return c.enabled[num];
+}
+
+inline void irq_set_mask_enabled(uint32_t mask, bool enabled)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    for (uint i = 0; i < NUM_IRQS; i++)
+        if (mask & (1u << i))
+            c.enabled[i] = enabled;
+    if (enabled)
+        pico_mock::deliver();
+}
+
+inline void irq_set_pending(uint num)
+{
+    pico_mock::raise_irq(num);
+}
+
+inline void irq_clear(uint num)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    c.pending[num] = false;
+}
+
+inline void irq_set_priority(uint num, uint8_t hardware_priority)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    c.priority[num] = hardware_priority;
+}
+
+inline uint irq_get_priority(uint num)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    return c.priority[num];
+}
+
+inline int user_irq_claim_unused(bool required)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    for (int i = NUM_USER_IRQS - 1; i >= 0; i--)
+        if (!c.user_irq_claimed[i])
+        {
+            c.user_irq_claimed[i] = true;
+            return FIRST_USER_IRQ + i;
+        }
+    if (required)
+        panic("No user IRQs are available");
+    return -1;
+}
+
+inline void user_irq_claim(uint irq_num)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    if (c.user_irq_claimed[irq_num - FIRST_USER_IRQ])
+        panic("User IRQ %u is already claimed", irq_num);
+    c.user_irq_claimed[irq_num - FIRST_USER_IRQ] = true;
+}
+
+inline void user_irq_unclaim(uint irq_num)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    c.user_irq_claimed[irq_num - FIRST_USER_IRQ] = false;
+}
+
+/* hardware/exception.h */
+
+inline exception_handler_t exception_set_exclusive_handler(enum exception_number num, exception_handler_t handler)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    exception_handler_t original = c.exceptions[num + 16];
+    c.exceptions[num + 16] = handler;
+    return original;
+}
+
+inline void exception_restore_handler(enum exception_number num, exception_handler_t original_handler)
+{
+    exception_set_exclusive_handler(num, original_handler);
+}
+
+/* hardware/gpio.h */
+
+inline void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    if (enabled)
+        c.gpio_enabled_events[gpio] |= event_mask;
+    else
+        c.gpio_enabled_events[gpio] &= ~event_mask;
+    c.gpio_pending_events[gpio] &= c.gpio_enabled_events[gpio];
+}
+
+inline void gpio_set_irq_callback(gpio_irq_callback_t callback)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    c.gpio_callback = callback;
+    if (c.exclusive[IO_IRQ_BANK0] != &pico_mock::gpio_bank0_handler)
+    {
+        c.exclusive[IO_IRQ_BANK0] = &pico_mock::gpio_bank0_handler;
+        c.shared[IO_IRQ_BANK0].clear();
+    }
+}
+
+inline void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    gpio_set_irq_enabled(gpio, event_mask, enabled);
+    gpio_set_irq_callback(callback);
+    if (enabled)
+        irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+inline void gpio_acknowledge_irq(uint gpio, uint32_t event_mask)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    c.gpio_pending_events[gpio] &= ~event_mask;
+}
+
+/* hardware/timer.h */
+
+inline uint64_t time_us_64(void)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    return c.now_us;
+}
+
+inline uint32_t time_us_32(void)
+{
+    return (uint32_t)time_us_64();
+}
+
+inline void hardware_alarm_claim(uint alarm_num)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    if (c.hardware_alarm_claimed[alarm_num])
+        panic("Hardware alarm %u already claimed", alarm_num);
+    c.hardware_alarm_claimed[alarm_num] = true;
+}
+
+inline int hardware_alarm_claim_unused(bool required)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    // Alarm 3 belongs to the default alarm pool, as on the real SDK.
+    for (uint i = 0; i < NUM_TIMERS - 1; i++)
+        if (!c.hardware_alarm_claimed[i])
+        {
+            c.hardware_alarm_claimed[i] = true;
+            return i;
+        }
+    if (required)
+        panic("No hardware alarms are available");
+    return -1;
+}
+
+inline void hardware_alarm_unclaim(uint alarm_num)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    c.hardware_alarm_claimed[alarm_num] = false;
+}
+
+inline void hardware_alarm_cancel(uint alarm_num)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    if (c.hardware_alarm_event[alarm_num])
+        pico_mock::cancel(c.hardware_alarm_event[alarm_num]);
+    c.hardware_alarm_event[alarm_num] = 0;
+}
+
+inline void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback)
+{
+    static const irq_handler_t handlers[NUM_TIMERS] =
+    {
+        &pico_mock::hardware_alarm_handler<0>, &pico_mock::hardware_alarm_handler<1>,
+        &pico_mock::hardware_alarm_handler<2>, &pico_mock::hardware_alarm_handler<3>,
+    };
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    c.hardware_alarm_callbacks[alarm_num] = callback;
+    c.exclusive[TIMER_IRQ_0 + alarm_num] = callback ? handlers[alarm_num] : nullptr;
+    irq_set_enabled(TIMER_IRQ_0 + alarm_num, callback != nullptr);
+    if (!callback)
+        hardware_alarm_cancel(alarm_num);
+}
+
+/**
+ * @return true if the target was already in the past, in which case the alarm does not fire (like the SDK)
+ */
+inline bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    hardware_alarm_cancel(alarm_num);
+    if (t <= c.now_us)
+        return true;
+    c.hardware_alarm_event[alarm_num] = pico_mock::schedule(t, [alarm_num]
+    {
+        pico_mock::state().hardware_alarm_event[alarm_num] = 0;
+        pico_mock::raise_irq(TIMER_IRQ_0 + alarm_num);
+    });
+    return false;
+}
+
+/* pico/time.h */
+
+inline absolute_time_t get_absolute_time(void) { return time_us_64(); }
+inline uint64_t to_us_since_boot(absolute_time_t t) { return t; }
+inline uint32_t to_ms_since_boot(absolute_time_t t) { return (uint32_t)(t / 1000); }
+inline absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us) { return t + us; }
+inline absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) { return t + ms * 1000ull; }
+inline absolute_time_t make_timeout_time_us(uint64_t us) { return delayed_by_us(get_absolute_time(), us); }
+inline absolute_time_t make_timeout_time_ms(uint32_t ms) { return delayed_by_ms(get_absolute_time(), ms); }
+inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) { return (int64_t)(to - from); }
+
+/**
+ * @brief Sleeping is how driver code lets simulated time pass.
+ */
+inline void sleep_us(uint64_t us) { pico_mock::advance_us(us); }
+inline void sleep_ms(uint32_t ms) { pico_mock::advance_us(ms * 1000ull); }
+
+namespace pico_mock
+{
+    /**
+     * @brief Alarm pool callbacks run from TIMER_IRQ_3, like the SDK's default pool.
+     */
+    inline void alarm_pool_handler()
+    {
+        chip& c = state();
+        std::vector<std::function<void()>> due;
+        due.swap(c.due_alarms);
+        for (auto& fire : due)
+            fire();
+    }
+
+    inline void schedule_alarm(alarm_id_t id, uint64_t when, alarm_callback_t callback, void* user_data)
+    {
+        chip& c = state();
+        c.exclusive[TIMER_IRQ_3] = &alarm_pool_handler;
+        c.enabled[TIMER_IRQ_3] = true;
+        c.events.emplace(id, chip::event { when, [=]
+        {
+            state().due_alarms.push_back([=]
+            {
+                int64_t again = callback(id, user_data);
+                // >0 is relative to now, <0 is relative to when this one was supposed to fire.
+                if (again)
+                    schedule_alarm(id, again > 0 ? state().now_us + again : when - again, callback, user_data);
+            });
+            raise_irq(TIMER_IRQ_3);
+        } });
+    }
+}
+
+inline alarm_id_t add_alarm_at(absolute_time_t time, alarm_callback_t callback, void* user_data, bool fire_if_past)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    if (time <= c.now_us && !fire_if_past)
+        return 0;
+    alarm_id_t id = (alarm_id_t)c.next_event++;
+    pico_mock::schedule_alarm(id, time, callback, user_data);
+    return id;
+}
+
+inline alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void* user_data, bool fire_if_past)
+{
+    return add_alarm_at(make_timeout_time_us(us), callback, user_data, fire_if_past);
+}
+
+inline alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void* user_data, bool fire_if_past)
+{
+    return add_alarm_at(make_timeout_time_ms(ms), callback, user_data, fire_if_past);
+}
+
+inline bool cancel_alarm(alarm_id_t alarm_id)
+{
+    return pico_mock::cancel(alarm_id);
+}
+
+namespace pico_mock
+{
+    inline int64_t repeating_timer_alarm(alarm_id_t id, void* user_data)
+    {
+        repeating_timer_t* rt = static_cast<repeating_timer_t*>(user_data);
+        if (!rt->callback(rt))
+        {
+            rt->alarm_id = 0;
+            return 0;
+        }
+        rt->alarm_id = id;
+        return rt->delay_us;
+    }
+}
+
+/**
+ * @param delay_us Negative to time from the start of the previous callback, positive from its end.
+ * Simulated callbacks take no time, so both behave the same here.
+ */
+inline bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void* user_data, repeating_timer_t* out)
+{
+    if (!delay_us)
+        delay_us = 1;
+    out->delay_us = delay_us;
+    out->pool = nullptr;
+    out->callback = callback;
+    out->user_data = user_data;
+    out->alarm_id = add_alarm_in_us((uint64_t)(delay_us < 0 ? -delay_us : delay_us), &pico_mock::repeating_timer_alarm, out, true);
+    return out->alarm_id > 0;
+}
+
+inline bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t callback, void* user_data, repeating_timer_t* out)
+{
+    return add_repeating_timer_us(delay_ms * (int64_t)1000, callback, user_data, out);
+}
+
+inline bool cancel_repeating_timer(repeating_timer_t* timer)
+{
+    bool cancelled = false;
+    if (timer->alarm_id)
+        cancelled = cancel_alarm(timer->alarm_id);
+    timer->alarm_id = 0;
+    return cancelled;
+}
+
+/* pico/multicore.h */
+
+/**
+ * @brief Entries in each SIO FIFO, as on the RP2040.
+ */
+#define SIO_FIFO_DEPTH 8
+
+inline bool multicore_fifo_rvalid(void)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    return !c.fifo[c.core_num].empty();
+}
+
+inline bool multicore_fifo_wready(void)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    return c.fifo[1 - c.core_num].size() < SIO_FIFO_DEPTH;
+}
+
+/**
+ * @brief Pushes to the other core and raises its SIO IRQ.
+ *
+ * Nothing else can drain a full FIFO in the mock, so where the SDK would wait forever this panics.
+ */
+inline void multicore_fifo_push_blocking(uint32_t data)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    uint other = 1 - c.core_num;
+    if (c.fifo[other].size() >= SIO_FIFO_DEPTH)
+        pico_mock::deliver();
+    if (c.fifo[other].size() >= SIO_FIFO_DEPTH)
+        panic("Core %u's FIFO is full and nothing is draining it", other);
+    c.fifo[other].push_back(data);
+    pico_mock::raise_irq(SIO_IRQ_PROC0 + other);
+}
+
+/**
+ * @brief Pops from this core's FIFO; panics if it's empty, since nothing could ever fill it while waiting.
+ */
+inline uint32_t multicore_fifo_pop_blocking(void)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    if (c.fifo[c.core_num].empty())
+        panic("Core %u's FIFO is empty and nothing is filling it", c.core_num);
+    uint32_t data = c.fifo[c.core_num].front();
+    c.fifo[c.core_num].pop_front();
+    return data;
+}
+
+inline void multicore_fifo_drain(void)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    c.fifo[c.core_num].clear();
+}
+
+inline void multicore_fifo_clear_irq(void)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    c.pending[SIO_IRQ_PROC0 + c.core_num] = false;
+}
+
+/* hardware/clocks.h */
+
+inline void clocks_enable_resus(resus_callback_t resus_callback)
+{
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    c.resus_callback = resus_callback;
+    c.exclusive[CLOCKS_IRQ] = &pico_mock::clocks_handler;
+    irq_set_enabled(CLOCKS_IRQ, true);
+}
+
+/* hardware/rtc.h */
+
+inline void rtc_set_alarm(datetime_t* t, rtc_callback_t user_callback)
+{
+    (void)t; // When it fires is up to the test, see pico_mock::rtc_alarm().
+    pico_mock::chip& c = pico_mock::state();
+    pico_mock::on_core lock { c.core };
+    c.rtc_callback = user_callback;
+    c.exclusive[RTC_IRQ] = &pico_mock::rtc_handler;
+    irq_set_enabled(RTC_IRQ, true);
+}
+
+inline void rtc_enable_alarm(void) { irq_set_enabled(RTC_IRQ, true); }
+inline void rtc_disable_alarm(void) { irq_set_enabled(RTC_IRQ, false); }
+
+#endif /* PICO_MOCK_H */
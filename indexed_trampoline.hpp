@@ -0,0 +1,174 @@
+#ifndef INDEXED_TRAMPOLINE_H
+#define INDEXED_TRAMPOLINE_H
+#include "c_trampoline.hpp"
+
+/**
+ * @brief The code and literals for up to 256 callbacks of an indexed_trampoline_pool.
+ *
+ * Entries are `movs r3, #k; b stub`, four bytes each, and the one stub after them works out self from k.
+ * Every block has the same code; only the base literal differs.
+ *
+ * @tparam Count Number of incoming arguments.
+ * @tparam Entries Number of entries in the block.
+ */
+template<size_t Count, size_t Entries> struct indexed_block
+{
+    /**
+     * @brief Halfwords of code, padded so the literals stay word aligned.
+     */
+    static constexpr size_t length = Entries * 2 + ((Count + 7 + 1) & ~size_t { 1 });
+    static constexpr size_t size_at = length * 2;
+    static constexpr size_t base_at = size_at + sizeof(uint32_t);
+    static constexpr size_t method_at = base_at + sizeof(uint32_t);
+
+    static constexpr thumb_asm::code<length> opcodes = []
+    {
+        thumb_asm::code<length> c;
+        thumb_asm::assemble_indexed_block(c, Count, Entries, size_at, base_at, method_at);
+        return c;
+    }();
+    static_assert(opcodes.size == length && !opcodes.failed, "Thunk failed to assemble.");
+    static_assert(thumb_model::fuzz_indexed_block(opcodes.op, Count, Entries, 16), "Thunk differs from a direct call to the indexed object's method.");
+
+    /**
+     * @brief Cortex-M0+ cycles from an entry up to and including the branch to the method.
+     */
+    static constexpr unsigned cycles = thumb_model::run_indexed_block(opcodes.op, 0, 1, 0, 1, { }).cycles;
+
+    uint16_t volatile __attribute__((aligned(4))) code[length];
+    uint32_t const size; // DO NOT change the order of this member or code will be invalid!
+    uint32_t const base; // DO NOT change the order of this member or code will be invalid!
+    uint32_t const method; // DO NOT change the order of this member or code will be invalid!
+
+    constexpr indexed_block(uint32_t size, uint32_t base, uint32_t method) : indexed_block(size, base, method, std::make_index_sequence<length>()) { }
+    template<size_t... I> constexpr indexed_block(uint32_t size, uint32_t base, uint32_t method, std::index_sequence<I...>)
+        : code { opcodes.op[I]... }, size { size }, base { base }, method { method } { }
+};
+
+/**
+ * @brief Callbacks for every object in an array, sharing one method, at four bytes a callback.
+ *
+ * A c_trampoline per object costs 16-24 bytes plus the pointer back to it, which adds up over a pool of
+ * thousands of small objects. Here each callback is just `movs r3, #k; b stub` and each block of 256 shares
+ * a stub that computes `&objects[block * 256 + k]` and calls the pool's method with it, so objects stay
+ * densely packed in their own array and the callbacks cost little more than the table they'd be in anyway:
+ * @code
+ * sensor sensors[1000];
+ * indexed_trampoline_pool<sensor, void(uint32_t), 1000> sensor_alarms { sensors, &sensor::on_alarm };
+ * hardware_alarm_set_callback(0, sensor_alarms[42]);  // calls sensors[42].on_alarm(alarm)
+ * @endcode
+ *
+ * The stub needs r3 for the index, so at most two arguments. All the blocks read the method from the pool,
+ * so set_method changes every callback with one store.
+ *
+ * On the host each callback handed out takes a c_trampoline_host slot, so raise C_TRAMPOLINE_HOST_SLOTS to suit.
+ *
+ * @warning Same caveats as c_trampoline. The objects must outlive the pool.
+ *
+ * @tparam T Class of the objects.
+ * @tparam Callback C callback signature being served, e.g. void() for irq_handler_t.
+ * @tparam Count Number of objects, up to 65536.
+ */
+template<typename T, typename Callback, size_t Count> struct indexed_trampoline_pool;
+
+template<typename T, typename R, FitsInRegister... Args, size_t Count>
+requires RegisterReturn<R> && NotTooManyArgs<2, Args...> && (Count > 0 && Count <= 65536)
+struct __attribute__((aligned(4))) indexed_trampoline_pool<T, R(Args...), Count>
+{
+        typedef R (T::*member_function_pointer)(Args...);
+        typedef R (*function_pointer)(Args...);
+
+        /**
+         * @brief Entries per block; the last block may be partly unused.
+         */
+        static constexpr size_t block_entries = Count < 256 ? Count : 256;
+        static constexpr size_t block_count = (Count + block_entries - 1) / block_entries;
+
+        /**
+         * @param objects The first of Count objects.
+         * @param method Method every callback calls on its object.
+         */
+        indexed_trampoline_pool(T* objects, member_function_pointer method)
+            : indexed_trampoline_pool(objects, method, std::make_index_sequence<block_count>()) { }
+
+        indexed_trampoline_pool(const indexed_trampoline_pool&) = delete;
+        indexed_trampoline_pool& operator=(const indexed_trampoline_pool&) = delete;
+
+        /**
+         * @brief Returns the callback for object index, which can be passed to whatever wants a legit callback.
+         */
+        function_pointer get_callback(size_t index) const
+        {
+#ifdef __thumb__
+            const Block& b = blocks[index / block_entries];
+            return reinterpret_cast<function_pointer>((uint8_t*)&b.code[index % block_entries * 2] + 1); // Plus one to stay in Thumb mode.
+#else
+            host_entry& e = host_entries[index];
+            return e.host_slot.get(&e, &host_invoke);
+#endif /* __thumb__ */
+        }
+        function_pointer operator[](size_t index) const
+        {
+            return get_callback(index);
+        }
+
+        /**
+         * @brief Changes the method every callback calls.
+         */
+        void set_method(member_function_pointer new_method)
+        {
+            method = new_method;
+        }
+        member_function_pointer get_method() const
+        {
+            return method;
+        }
+
+        static constexpr size_t size()
+        {
+            return Count;
+        }
+
+        /**
+         * @brief Cortex-M0+ cycles from a callback's first instruction up to and including the branch to the method.
+         */
+        static constexpr unsigned thunk_cycles = indexed_block<sizeof...(Args), block_entries>::cycles;
+
+    private:
+        typedef indexed_block<sizeof...(Args), block_entries> Block;
+
+        template<size_t... B> indexed_trampoline_pool(T* objects, member_function_pointer method, std::index_sequence<B...>)
+            : method { method },
+              blocks { Block { sizeof(T), uint32_t(reinterpret_cast<uintptr_t>(objects + B * block_entries)), uint32_t(reinterpret_cast<uintptr_t>(&this->method)) }... }
+        {
+#ifndef __thumb__
+            for (size_t i = 0; i < Count; i++)
+            {
+                host_entries[i].pool = this;
+                host_entries[i].self = objects + i;
+            }
+#endif /* __thumb__ */
+        }
+
+        /**
+         * @brief The blocks load the first word, which is the code address of a non-virtual method.
+         */
+        member_function_pointer method;
+        Block blocks[block_count];
+#ifndef __thumb__
+        struct host_entry
+        {
+            indexed_trampoline_pool* pool = nullptr;
+            T* self = nullptr;
+            c_trampoline_host::slot<R, Args...> host_slot;
+        };
+        mutable host_entry host_entries[Count];
+        static R host_invoke(void* context, Args... args)
+        {
+            host_entry& e = *static_cast<host_entry*>(context);
+            return (e.self->*e.pool->method)(args...);
+        }
+#endif /* __thumb__ */
+};
+
+#endif /* INDEXED_TRAMPOLINE_H */
@@ -0,0 +1,251 @@
+#ifndef LAZY_TRAMPOLINE_H
+#define LAZY_TRAMPOLINE_H
+#include <array>
+#include <atomic>
+#include <tuple>
+#include "hardware/sync.h"
+#include "c_trampoline.hpp"
+
+/**
+ * @brief A c_trampoline whose object is found on first use, so the callback can be handed out before the object exists.
+ *
+ * Same idea as a PLT entry: the thunk's first instruction starts out as a branch to a second thunk that calls
+ * a resolver instead of the method. The resolver asks the locator for the object, and if there is one yet,
+ * fills in self and then patches the first instruction back to the ordinary thunk's, after which calls go
+ * straight to the method at the usual cost. The patch is a single halfword store, so a call that comes in
+ * at the same time runs one path or the other, never half of each.
+ *
+ * Calls that arrive before the locator has anything to offer are queued (up to QueueDepth, and then only for
+ * void callbacks) and replayed in order once bound, or dropped and counted. Non-void callbacks return R { } when dropped.
+ *
+ * Without a locator it simply stays unbound, dropping (and counting) calls, until bind() is called, and
+ * unbind() puts it back. unbind() is one halfword store. bind() is more: a fence once self is set, then the
+ * queue replayed in the caller's context, then a last check of the queue and the patch with interrupts masked
+ * for just those few instructions. Either way the caller doesn't mask anything, so handlers can all be
+ * registered at init and switched on or off later.
+ *
+ * The constructors are constexpr, so a constinit global has a working callback before any constructors run:
+ * @code
+ * lazy_trampoline<usb_stack, void()> usb_irq { &usb_stack::instance, &usb_stack::on_irq };
+ * // Early in boot:
+ * irq_set_exclusive_handler(USBCTRL_IRQ, usb_irq);
+ * @endcode
+ *
+ * @warning Same caveats as c_trampoline. The queue isn't protected against the trampoline being called
+ * reentrantly from a higher priority while a call is being added to it, or from the other core at all.
+ *
+ * @tparam T Class the method belongs to.
+ * @tparam Callback C callback signature being served.
+ * @tparam QueueDepth Early calls to hold on to; zero drops them all.
+ */
+template<typename T, typename Callback, size_t QueueDepth = 0> struct lazy_trampoline;
+
+template<typename T, typename R, FitsInRegister... Args, size_t QueueDepth>
+requires RegisterReturn<R> && NotTooManyArgs<3, Args...> && (QueueDepth == 0 || VoidReturn<R>)
+struct C_TRAMPOLINE_LAYOUT(4) lazy_trampoline<T, R(Args...), QueueDepth>
+{
+        typedef R (T::*member_function_pointer)(Args...);
+        typedef R (*function_pointer)(Args...);
+        /**
+         * @brief Returns the object once it exists, nullptr before then.
+         */
+        typedef T* (*locator)();
+
+        /**
+         * @param locate Called on each call while unbound until it returns the object.
+         * @param method Member function pointer you want adapted for use with C.
+         */
+        constexpr lazy_trampoline(locator locate, member_function_pointer method)
+            : asm_code { thumb_asm::b(0, resolve_at) }, self { nullptr }, method { method },
+              trampoline { this }, resolver { &resolve }, locate { locate }
+        {
+#ifdef __thumb__
+            static_assert(offsetof(lazy_trampoline, self) == Code::literals_at);
+            static_assert(offsetof(lazy_trampoline, method) == Code::literals_at + sizeof(T*));
+            static_assert(offsetof(lazy_trampoline, resolve_code) == resolve_at);
+            static_assert(offsetof(lazy_trampoline, trampoline) == resolve_at + Code::literals_at);
+#endif /* __thumb__ */
+        }
+
+        /**
+         * @brief Starts unbound and stays that way until bind().
+         */
+        constexpr lazy_trampoline(member_function_pointer method)
+            : lazy_trampoline(nullptr, method)
+        {
+        }
+
+        lazy_trampoline(const lazy_trampoline&) = delete;
+        lazy_trampoline& operator=(const lazy_trampoline&) = delete;
+
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        operator function_pointer() const
+        {
+            return get_callback();
+        }
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        function_pointer get_callback() const
+        {
+#ifdef __thumb__
+            return reinterpret_cast<function_pointer>((uint8_t*)&asm_code + 1); // Plus one to stay in Thumb mode.
+#else
+            return host_slot.get(const_cast<lazy_trampoline*>(this), &host_invoke);
+#endif /* __thumb__ */
+        }
+
+        /**
+         * @brief Binds to target now instead of waiting for the next call to find it, and replays anything queued.
+         *
+         * The replay happens here, in the caller's context, before the entry is patched: calls that come in
+         * meanwhile join the end of the queue, so everything reaches the method in order and never from a
+         * handler while the replay is running it. The last check of the queue and the patch are done with
+         * interrupts masked on this core; calls from the other core aren't held back.
+         */
+        void bind(T& target)
+        {
+            self = &target;
+            binding = true;
+            // self has to be in place before the thunk can get to it.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            for (size_t done = 0;;)
+            {
+                for (; done < queued; done++)
+                    std::apply([this](Args... args) { (self->*method)(args...); }, queue[done]);
+                uint32_t status = save_and_disable_interrupts();
+                bool drained = done == queued;
+                if (drained)
+                {
+                    queued = 0;
+                    binding = false;
+                    asm_code.code[0] = Code::opcodes.op[0];
+                }
+                restore_interrupts(status);
+                if (drained)
+                    return;
+            }
+        }
+        /**
+         * @brief Sends calls back to the resolver, which drops or queues them (or binds again if the locator says so).
+         *
+         * A call already past the entry instruction still reaches the current object, so it has to stay valid
+         * until that call has returned.
+         */
+        void unbind()
+        {
+            asm_code.code[0] = thumb_asm::b(0, resolve_at);
+        }
+        /**
+         * @brief True once calls go straight to the method.
+         */
+        bool bound() const
+        {
+            return asm_code.code[0] == Code::opcodes.op[0];
+        }
+        /**
+         * @brief Calls that arrived while unbound and didn't fit in the queue.
+         */
+        size_t dropped() const
+        {
+            return lost;
+        }
+
+        /**
+         * @brief Cortex-M0+ cycles spent in the trampoline once bound, up to and including the branch to method.
+         */
+        static constexpr unsigned thunk_cycles = adapter_code<literals_then_arguments<1, sizeof...(Args)>>::cycles;
+
+    private:
+        typedef adapter_code<literals_then_arguments<1, sizeof...(Args)>> Code;
+        /**
+         * @brief Byte offset of the thunk that calls resolve, which is where the entry branch goes until bound.
+         */
+        static constexpr size_t resolve_at = Code::literals_at + sizeof(T*) + sizeof(member_function_pointer);
+
+        Code asm_code;
+        T* self; // DO NOT change the order of this member or asm_code will be invalid!
+        member_function_pointer method; // DO NOT change the order of this member or asm_code will be invalid!
+        Code resolve_code; // DO NOT change the order of this member or asm_code will be invalid!
+        lazy_trampoline* const trampoline; // DO NOT change the order of this member or resolve_code will be invalid!
+        R (* const resolver)(lazy_trampoline*, Args...); // DO NOT change the order of this member or resolve_code will be invalid!
+        locator const locate;
+        std::array<std::tuple<Args...>, QueueDepth> queue { };
+        size_t volatile queued = 0;
+        size_t volatile lost = 0;
+        bool volatile binding = false; // Between bind() setting self and patching the entry.
+
+        static R resolve(lazy_trampoline* t, Args... args)
+        {
+            // A call can get here just after another one bound the trampoline.
+            if (!t->bound())
+            {
+                // Behind whatever bind() is still replaying.
+                if (t->binding)
+                {
+                    t->defer(args...);
+                    return R();
+                }
+                T* target = t->locate ? t->locate() : nullptr;
+                if (!target)
+                {
+                    t->defer(args...);
+                    return R();
+                }
+                t->bind(*target);
+            }
+            return (t->self->*t->method)(args...);
+        }
+        void defer(Args... args)
+        {
+            if constexpr (QueueDepth > 0)
+                if (queued < QueueDepth)
+                {
+                    queue[queued] = { args... };
+                    // The entry has to be written before bind() can see it counted.
+                    std::atomic_signal_fence(std::memory_order_seq_cst);
+                    queued = queued + 1;
+                    return;
+                }
+            lost = lost + 1;
+        }
+#ifndef __thumb__
+        c_trampoline_host::slot<R, Args...> host_slot;
+        static R host_invoke(void* context, Args... args)
+        {
+            lazy_trampoline& t = *static_cast<lazy_trampoline*>(context);
+            if (!t.bound())
+                return resolve(&t, args...);
+            return (t.self->*t.method)(args...);
+        }
+#endif /* __thumb__ */
+
+        // The model lays the thunks out as they are on the target, whatever the host's pointer sizes.
+        static constexpr size_t model_resolve_at = Code::literals_at + 3 * sizeof(uint32_t);
+#ifdef __thumb__
+        static_assert(resolve_at == model_resolve_at);
+#endif /* __thumb__ */
+        static constexpr uint32_t trampoline_marker = 0x7A3B0071;
+        static constexpr uint32_t resolver_marker = 0x2E501E01;
+        static constexpr thumb_model::outcome unbound_model = thumb_model::run_with_alternate(Code::opcodes.op, thumb_asm::b(0, model_resolve_at),
+            thumb_model::self_marker, thumb_model::method_marker, Code::opcodes.op, trampoline_marker, resolver_marker,
+            { thumb_model::argument_marker(0), thumb_model::argument_marker(1), thumb_model::argument_marker(2), thumb_model::argument_marker(3) });
+        static_assert(unbound_model.ok && unbound_model.target == resolver_marker && unbound_model.reg[0] == trampoline_marker
+            && (sizeof...(Args) < 1 || unbound_model.reg[1] == thumb_model::argument_marker(0))
+            && (sizeof...(Args) < 2 || unbound_model.reg[2] == thumb_model::argument_marker(1))
+            && (sizeof...(Args) < 3 || unbound_model.reg[3] == thumb_model::argument_marker(2)), "Unbound entry doesn't reach resolve with the arguments.");
+        static_assert(thumb_model::forwards_to_method(thumb_model::run_with_alternate(Code::opcodes.op, Code::opcodes.op[0],
+            thumb_model::self_marker, thumb_model::method_marker, Code::opcodes.op, trampoline_marker, resolver_marker,
+            { thumb_model::argument_marker(0), thumb_model::argument_marker(1), thumb_model::argument_marker(2), thumb_model::argument_marker(3) }), sizeof...(Args)),
+            "Patched entry doesn't reach method.");
+        // bind() racing a call must give either the resolver or the method with self, never the method with no self.
+        // Checking the other order too keeps the check honest: it's exactly the mistake the first one guards against.
+        static_assert(thumb_model::bind_race(Code::opcodes.op, thumb_asm::b(0, model_resolve_at), Code::opcodes.op, trampoline_marker, resolver_marker, true).clean(),
+            "A call racing bind can reach method before self is set.");
+        static_assert(thumb_model::bind_race(Code::opcodes.op, thumb_asm::b(0, model_resolve_at), Code::opcodes.op, trampoline_marker, resolver_marker, false).torn,
+            "The interleaving check can't see bind done in the wrong order.");
+};
+
+#endif /* LAZY_TRAMPOLINE_H */
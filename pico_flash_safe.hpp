@@ -0,0 +1,126 @@
+#ifndef PICO_FLASH_SAFE_H
+#define PICO_FLASH_SAFE_H
+#include "hardware/irq.h"
+#include "pico/platform.h"
+#ifdef __thumb__
+#include "hardware/regs/addressmap.h"
+#endif /* __thumb__ */
+#include "c_trampoline.hpp"
+
+/**
+ * @file
+ * @brief Interrupt handlers that keep running while flash is being written.
+ *
+ * While flash is erased or programmed XIP is gone, so anything that runs has to be in RAM. The usual answer is
+ * to mask every interrupt for the duration. A trampoline is already in RAM, so if the method it calls is too
+ * (put it, and everything it calls, in RAM with __not_in_flash_func), its IRQ can stay enabled.
+ *
+ * flash_safe_irq checks that the method really is in SRAM when it's bound and panics if not, since where
+ * the linker put it isn't known until then. It can't see what the method calls, so that's still on you.
+ * flash_safe_section then masks every other IRQ around the flash operation instead of all of them:
+ * @code
+ * struct motor
+ * {
+ *     flash_safe_irq<motor> pwm_irq { *this, &motor::on_wrap, PWM_IRQ_WRAP };
+ *     void __not_in_flash_func(on_wrap)();
+ * };
+ * {
+ *     flash_safe_section guard;
+ *     flash_range_erase(offset, FLASH_SECTOR_SIZE);
+ * }
+ * @endcode
+ *
+ * @warning This covers this core's IRQs. The other core has to be kept out of flash separately (e.g. multicore_lockout),
+ * and system exceptions such as SysTick aren't masked by the NVIC, so their handlers need to be in RAM or disabled.
+ */
+namespace flash_safe
+{
+    static_assert(NUM_IRQS <= 32, "IRQ masks here are one word.");
+
+    /**
+     * @brief IRQs with a flash_safe_irq handler, which flash_safe_section leaves enabled by default.
+     */
+    inline uint32_t volatile irq_mask = 0;
+
+    /**
+     * @brief True if code at address runs from SRAM rather than flash. Always true on the host, which has no XIP to lose.
+     */
+    inline bool in_ram(uintptr_t address)
+    {
+#ifdef __thumb__
+        address &= ~uintptr_t { 1 }; // Thumb bit
+        return address >= SRAM_BASE && address < SRAM_END;
+#else
+        (void)address;
+        return true;
+#endif /* __thumb__ */
+    }
+}
+
+/**
+ * @brief Owns an exclusive IRQ handler that's allowed to run during flash operations.
+ *
+ * Panics on construction if the method isn't in SRAM (or is virtual, so can't be checked).
+ */
+template<typename T>
+struct flash_safe_irq
+{
+        flash_safe_irq(T& self, void (T::*method)(), uint irq, bool enable = true)
+            : irq { irq }, handler { self, method }
+        {
+            if (!flash_safe::in_ram(method_code_address(method)))
+                panic("IRQ %u handler isn't in RAM, so it can't run during flash operations", irq);
+            irq_set_exclusive_handler(irq, handler);
+            flash_safe::irq_mask = flash_safe::irq_mask | 1u << irq;
+            if (enable)
+                irq_set_enabled(irq, true);
+        }
+        ~flash_safe_irq()
+        {
+            irq_set_enabled(irq, false);
+            flash_safe::irq_mask = flash_safe::irq_mask & ~(1u << irq);
+            irq_remove_handler(irq, handler);
+        }
+
+        flash_safe_irq(const flash_safe_irq&) = delete;
+        flash_safe_irq& operator=(const flash_safe_irq&) = delete;
+
+        uint number() const
+        {
+            return irq;
+        }
+
+    private:
+        uint const irq;
+        c_trampoline<T, void> handler;
+};
+
+/**
+ * @brief Masks every enabled IRQ that isn't flash-safe for as long as it exists, in place of save_and_disable_interrupts().
+ */
+struct flash_safe_section
+{
+        flash_safe_section() : flash_safe_section(flash_safe::irq_mask) { }
+        /**
+         * @param keep IRQs to leave alone; their handlers must be entirely in RAM.
+         */
+        explicit flash_safe_section(uint32_t keep)
+        {
+            for (uint i = 0; i < NUM_IRQS; i++)
+                if (!(keep & 1u << i) && irq_is_enabled(i))
+                    masked |= 1u << i;
+            irq_set_mask_enabled(masked, false);
+        }
+        ~flash_safe_section()
+        {
+            irq_set_mask_enabled(masked, true);
+        }
+
+        flash_safe_section(const flash_safe_section&) = delete;
+        flash_safe_section& operator=(const flash_safe_section&) = delete;
+
+    private:
+        uint32_t masked = 0;
+};
+
+#endif /* PICO_FLASH_SAFE_H */
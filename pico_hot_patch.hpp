@@ -0,0 +1,306 @@
+#ifndef PICO_HOT_PATCH_H
+#define PICO_HOT_PATCH_H
+#include <stdint.h>
+#include <stddef.h>
+#include "pico_flash_safe.hpp"
+#include "profile_trampoline.hpp"
+
+/**
+ * @file
+ * @brief Replacing handler methods at run time with code loaded into RAM, no reset needed.
+ *
+ * A patch is an image, loaded into SRAM by whatever means (USB, radio, a spare flash sector copied over),
+ * holding new implementations for some of the methods behind a profile_group's trampolines.
+ * hot_patcher checks the image, builds a profile that's the current one with those slots pointed into it,
+ * and activates that, so every patched handler switches at once, and rollback() switches them all back.
+ *
+ * The image is a header, a table of entries, then code:
+ * @code
+ * hot_patch::header  { magic, abi, build, length, crc, count }
+ * hot_patch::entry   { id, offset } * count
+ * code, each function at its offset from the start of the image
+ * @endcode
+ * build is whatever identifies the firmware the patch was made against (say, a hash of the ELF), so a patch
+ * for some other build is refused. crc is CRC-32 over everything after the header. The functions have the
+ * member function calling convention, `R function(T* self, Args...)`, and have to be position independent:
+ * anything outside the image they reach through self or at fixed addresses, not through literals the linker
+ * would have to fix up.
+ * @code
+ * profile_group<> handlers;
+ * profile_trampoline<radio, void()> radio_irq { handlers, the_radio, &radio::on_irq };
+ * hot_patcher<> patcher { handlers, FIRMWARE_BUILD_ID };
+ * patcher.expose(RADIO_IRQ_ID, radio_irq);
+ * if (patcher.apply(buffer, received) != hot_patch::status::applied)
+ *     reject_patch();
+ * @endcode
+ *
+ * @warning The image has to stay put for as long as its profile might be active or running.
+ * Only trampolines in the group can be patched, not whatever they call.
+ */
+namespace hot_patch
+{
+    /**
+     * @brief "HPAT", little endian.
+     */
+    constexpr uint32_t magic = 0x54415048;
+    /**
+     * @brief Version of the image layout and calling convention.
+     */
+    constexpr uint32_t abi = 1;
+
+    struct header
+    {
+        uint32_t magic;
+        uint32_t abi;
+        uint32_t build;
+        /**
+         * @brief Bytes in the whole image, header included.
+         */
+        uint32_t length;
+        /**
+         * @brief CRC-32 of the length - sizeof(header) bytes after the header.
+         */
+        uint32_t crc;
+        /**
+         * @brief Number of entries following the header.
+         */
+        uint32_t count;
+    };
+
+    struct entry
+    {
+        /**
+         * @brief Which trampoline, as given to hot_patcher::expose.
+         */
+        uint32_t id;
+        /**
+         * @brief Byte offset of the function from the start of the image.
+         */
+        uint32_t offset;
+    };
+
+    enum class status : uint8_t
+    {
+        applied,
+        too_short, // smaller than its header and entry table, or than it says it is
+        misaligned, // not word aligned
+        not_in_ram, // can't be executed from where it is
+        bad_magic,
+        bad_abi,
+        wrong_build,
+        bad_crc,
+        bad_entry, // function offset is outside the code or odd
+        unknown_id,
+        busy, // the buffer it would be built in belonged to a profile that may still be running; see hot_patcher::settled()
+    };
+
+    /**
+     * @brief CRC-32 (IEEE 802.3, as zlib), bit at a time; patches are checked once so there's no table.
+     */
+    constexpr uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+    {
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+        {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; bit++)
+                crc = crc >> 1 ^ (0xEDB88320 & -(crc & 1));
+        }
+        return ~crc;
+    }
+
+    /**
+     * @brief Checks everything about an image except whether its ids mean anything.
+     *
+     * @param size Bytes available at image, which may be more than the image uses.
+     */
+    inline status validate(const void* image, size_t size, uint32_t build)
+    {
+        uintptr_t address = reinterpret_cast<uintptr_t>(image);
+        if (address % 4)
+            return status::misaligned;
+        if (size < sizeof(header))
+            return status::too_short;
+        if (!flash_safe::in_ram(address) || !flash_safe::in_ram(address + size - 1))
+            return status::not_in_ram;
+        const header& h = *static_cast<const header*>(image);
+        if (h.magic != magic)
+            return status::bad_magic;
+        if (h.abi != abi)
+            return status::bad_abi;
+        if (h.build != build)
+            return status::wrong_build;
+        if (h.length > size || h.length < sizeof(header) || h.count > (h.length - sizeof(header)) / sizeof(entry))
+            return status::too_short;
+        const uint8_t* bytes = static_cast<const uint8_t*>(image);
+        if (crc32(bytes + sizeof(header), h.length - sizeof(header)) != h.crc)
+            return status::bad_crc;
+        const entry* entries = reinterpret_cast<const entry*>(bytes + sizeof(header));
+        size_t code_at = sizeof(header) + h.count * sizeof(entry);
+        for (size_t i = 0; i < h.count; i++)
+            if (entries[i].offset < code_at || entries[i].offset >= h.length || entries[i].offset % 2)
+                return status::bad_entry;
+        return status::applied;
+    }
+}
+
+/**
+ * @brief Applies hot patches to the trampolines of one profile_group, one level of rollback.
+ *
+ * Patches stack: each one starts from whatever profile is active, so a second patch keeps the first's changes
+ * unless it replaces them. Apply patches and roll back from one context.
+ *
+ * There are two profile buffers, the active one and a spare that apply() builds in. Once a buffer has been
+ * switched away from (by apply() or rollback()), a call that loaded its target just before the switch may still be
+ * on its way through it, so apply() won't rewrite it, and returns hot_patch::status::busy, until settled() says
+ * those calls are over.
+ *
+ * @tparam Slots Size of the group.
+ */
+template<size_t Slots = 32>
+struct hot_patcher
+{
+        /**
+         * @param build Firmware identity patches have to match, see hot_patch::header.
+         */
+        hot_patcher(profile_group<Slots>& group, uint32_t build) : group { group }, build { build } { }
+
+        hot_patcher(const hot_patcher&) = delete;
+        hot_patcher& operator=(const hot_patcher&) = delete;
+
+        /**
+         * @brief Lets patches replace trampoline's method under the name id.
+         *
+         * @return False if id is already taken or the trampoline never got a slot.
+         */
+        template<typename T, typename Callback>
+        bool expose(uint32_t id, const profile_trampoline<T, Callback, Slots>& trampoline)
+        {
+            if (!trampoline.valid() || find(id) < Slots)
+                return false;
+            ids[trampoline.slot_index()] = id;
+            named[trampoline.slot_index()] = true;
+            return true;
+        }
+
+        /**
+         * @brief Validates image and, if it's good, switches every method it replaces over to it at once.
+         *
+         * Nothing changes unless this returns hot_patch::status::applied.
+         *
+         * @param size Bytes available at image.
+         */
+        hot_patch::status apply(const void* image, size_t size)
+        {
+            hot_patch::status result = hot_patch::validate(image, size, build);
+            if (result != hot_patch::status::applied)
+                return result;
+            const uint8_t* bytes = static_cast<const uint8_t*>(image);
+            const hot_patch::header& h = *reinterpret_cast<const hot_patch::header*>(bytes);
+            const hot_patch::entry* entries = reinterpret_cast<const hot_patch::entry*>(bytes + sizeof(hot_patch::header));
+            for (size_t i = 0; i < h.count; i++)
+                if (find(entries[i].id) == Slots)
+                    return hot_patch::status::unknown_id;
+
+            // Build into whichever buffer isn't active, so nothing running is touched.
+            size_t spare = &group.current() == &buffers[0] ? 1 : 0;
+            if (stale[spare])
+                return hot_patch::status::busy;
+            typename profile_group<Slots>::profile& next = buffers[spare];
+            next = group.current();
+            for (size_t i = 0; i < h.count; i++)
+                next.target[find(entries[i].id)] = reinterpret_cast<uintptr_t>(bytes + entries[i].offset) | 1; // Thumb
+#ifdef __thumb__
+            // The code was written as data; make sure it's all there before anything can branch to it.
+            __asm volatile ("dsb\n\tisb" ::: "memory");
+#endif /* __thumb__ */
+            previous = &group.current();
+            previous_image = active_image();
+            images[spare] = image;
+            leave();
+            group.activate(next);
+            return hot_patch::status::applied;
+        }
+
+        /**
+         * @brief Puts back the profile that was active before the last patch.
+         *
+         * The patched profile's buffer is the spare afterwards, so the next apply() waits for settled() too.
+         *
+         * @return False if there's nothing to roll back to.
+         */
+        bool rollback()
+        {
+            if (!previous)
+                return false;
+            leave();
+            group.activate(*previous);
+            previous = nullptr;
+            previous_image = nullptr;
+            return true;
+        }
+
+        /**
+         * @brief Says no call can still be running through a profile this switched away from, so apply() can reuse its buffer.
+         *
+         * Typically once every patched handler has returned since the switch, say after disarming and rearming
+         * their sources, or from a point that no handler can be preempting.
+         */
+        void settled()
+        {
+            stale[0] = stale[1] = false;
+        }
+
+        /**
+         * @brief The image the active profile runs code from, or null if it's not one of this patcher's.
+         */
+        const void* active_image() const
+        {
+            if (&group.current() == &buffers[0])
+                return images[0];
+            if (&group.current() == &buffers[1])
+                return images[1];
+            return nullptr;
+        }
+        /**
+         * @brief The image rollback() would go back to, or null for none (including the unpatched profile).
+         */
+        const void* rollback_image() const
+        {
+            return previous_image;
+        }
+
+    private:
+        profile_group<Slots>& group;
+        uint32_t const build;
+        uint32_t ids[Slots] = { };
+        bool named[Slots] = { };
+        typename profile_group<Slots>::profile buffers[2];
+        const void* images[2] = { };
+        bool stale[2] = { };
+        const typename profile_group<Slots>::profile* previous = nullptr;
+        const void* previous_image = nullptr;
+
+        /**
+         * @brief Marks the active profile's buffer, if it's one of these, as possibly still in use once it's switched away from.
+         */
+        void leave()
+        {
+            if (&group.current() == &buffers[0])
+                stale[0] = true;
+            if (&group.current() == &buffers[1])
+                stale[1] = true;
+        }
+        /**
+         * @brief Slot exposed as id, or Slots if none.
+         */
+        size_t find(uint32_t id) const
+        {
+            for (size_t i = 0; i < Slots; i++)
+                if (named[i] && ids[i] == id)
+                    return i;
+            return Slots;
+        }
+};
+
+#endif /* PICO_HOT_PATCH_H */
@@ -0,0 +1,386 @@
+#ifndef PICO_REGISTRATION_H
+#define PICO_REGISTRATION_H
+#include <atomic>
+#include "hardware/irq.h"
+#include "hardware/gpio.h"
+#include "hardware/timer.h"
+#include "pico/time.h"
+#include "pico_trampoline.hpp"
+
+/**
+ * @file
+ * @brief Trampolines that own their registration with the SDK.
+ *
+ * A bare irq_trampoline has no idea what it was handed to, so nothing stops it being destroyed while
+ * the SDK still points at it. These register in the constructor and, in the destructor, switch the source
+ * off, check that no call can still be on its way in, and then unregister, so a driver can be torn down
+ * and rebuilt at run time.
+ *
+ * disarm() and rearm() switch the source off and on again without the cost of unregistering. Both act on
+ * the core they're called on, like the SDK calls underneath them: a handler that takes calls on both cores
+ * (a shared IRQ enabled on each, say) is rearmed on each, and has to be disarmed on each before it's destroyed.
+ *
+ * @warning Don't destroy (or disarm) one of these from its own handler or from anything that preempts it;
+ * that panics rather than waiting for a call that can't finish.
+ */
+
+/**
+ * @brief Calls a method through a c_trampoline, counting calls in and out so teardown can wait for them.
+ *
+ * Everything is kept per core: a pair of counters and an open flag for each, written only by the handler
+ * running on that core (which can't preempt itself) or by reopen() and quiesce() called there, so plain
+ * volatile words do even with the handler on both cores. It costs one extra call, a core number read,
+ * two increments, a barrier and a check per invocation over a bare trampoline.
+ *
+ * reopen() and quiesce() act on the core they're called on, and calls are only let through on cores that
+ * have reopened. Since quiesce() isn't called from the handler or anything preempting it, no call on its own
+ * core can be between the trampoline and the count, so once that core's counts match nothing is left there.
+ * A call on the other core could be in that gap, where no count can see it. So the handshake is that every
+ * core that was let in quiesces itself before the storage goes, and release() panics if one hasn't.
+ *
+ * @tparam T Class the method belongs to.
+ * @tparam Callback C callback type being served, e.g. irq_handler_t.
+ */
+template<typename T, typename Callback> struct counted_method;
+
+template<typename T, typename R, typename... Args>
+struct counted_method<T, R (*)(Args...)>
+{
+        typedef R (T::*member_function_pointer)(Args...);
+        typedef R (*function_pointer)(Args...);
+
+        counted_method(T& self, member_function_pointer method)
+            : self { &self }, method { method }
+        {
+        }
+
+        counted_method(const counted_method&) = delete;
+        counted_method& operator=(const counted_method&) = delete;
+
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        function_pointer get_callback() const
+        {
+            return trampoline.get_callback();
+        }
+
+        /**
+         * @brief Turns away new calls on this core and waits for any on this core to finish.
+         *
+         * One still running here can only be one this was called from (or preempted), which would never
+         * finish, so that panics instead.
+         */
+        void quiesce()
+        {
+            uint core = get_core_num();
+            open[core] = false;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (entered[core] != exited[core])
+                panic("counted_method: quiesced from inside its own call on core %u", core);
+        }
+        /**
+         * @brief Lets calls on this core through to the method again.
+         */
+        void reopen()
+        {
+            open[get_core_num()] = true;
+        }
+        /**
+         * @brief Panics unless every core has quiesced, so there's no call left on its way in when the storage goes.
+         */
+        void release() const
+        {
+            for (uint core = 0; core < 2; core++)
+                if (open[core])
+                    panic("counted_method: still open on core %u; disarm it there before destroying it", core);
+        }
+
+    private:
+        struct in_flight
+        {
+            counted_method& counted;
+            uint const core;
+            in_flight(counted_method& counted) : counted { counted }, core { get_core_num() }
+            {
+                counted.entered[core] = counted.entered[core] + 1;
+                // Counted before checking open, the other way round from quiesce().
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+            ~in_flight() { counted.exited[core] = counted.exited[core] + 1; }
+        };
+        R dispatch(Args... args)
+        {
+            in_flight scope { *this };
+            if (!open[scope.core])
+                return R();
+            return (self->*method)(args...);
+        }
+
+        T* const self;
+        member_function_pointer const method;
+        uint32_t volatile entered[2] = { };
+        uint32_t volatile exited[2] = { };
+        bool volatile open[2] = { };
+        trampoline_for<counted_method, function_pointer> trampoline { *this, &counted_method::dispatch };
+};
+
+/**
+ * @brief Owns an exclusive IRQ handler.
+ */
+template<typename T>
+struct irq_registration
+{
+        irq_registration(T& self, void (T::*method)(), uint irq, bool enable = true)
+            : irq { irq }, handler { self, method }
+        {
+            irq_set_exclusive_handler(irq, handler.get_callback());
+            if (enable)
+                rearm();
+        }
+        ~irq_registration()
+        {
+            disarm();
+            handler.release();
+            irq_remove_handler(irq, handler.get_callback());
+        }
+
+        irq_registration(const irq_registration&) = delete;
+        irq_registration& operator=(const irq_registration&) = delete;
+
+        /**
+         * @brief Enables the IRQ.
+         */
+        void rearm()
+        {
+            handler.reopen();
+            irq_set_enabled(irq, true);
+        }
+        /**
+         * @brief Disables the IRQ and turns away any call still arriving on this core.
+         */
+        void disarm()
+        {
+            irq_set_enabled(irq, false);
+            handler.quiesce();
+        }
+        uint number() const
+        {
+            return irq;
+        }
+
+    private:
+        uint const irq;
+        counted_method<T, irq_handler_t> handler;
+};
+
+/**
+ * @brief Owns one of several handlers on a shared IRQ.
+ *
+ * Other handlers still need the IRQ, so disarming removes this one rather than disabling the IRQ.
+ * Enabling the IRQ in the first place is left to whoever owns it.
+ */
+template<typename T>
+struct shared_irq_registration
+{
+        shared_irq_registration(T& self, void (T::*method)(), uint irq, uint8_t order_priority = PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY)
+            : irq { irq }, order_priority { order_priority }, handler { self, method }
+        {
+            rearm();
+        }
+        ~shared_irq_registration()
+        {
+            disarm();
+            handler.release();
+        }
+
+        shared_irq_registration(const shared_irq_registration&) = delete;
+        shared_irq_registration& operator=(const shared_irq_registration&) = delete;
+
+        /**
+         * @brief Adds the handler back if it was removed.
+         */
+        void rearm()
+        {
+            handler.reopen();
+            if (!armed)
+                irq_add_shared_handler(irq, handler.get_callback(), order_priority);
+            armed = true;
+        }
+        /**
+         * @brief Removes the handler and turns away any call still arriving on this core.
+         */
+        void disarm()
+        {
+            if (armed)
+                irq_remove_handler(irq, handler.get_callback());
+            armed = false;
+            handler.quiesce();
+        }
+        uint number() const
+        {
+            return irq;
+        }
+
+    private:
+        uint const irq;
+        uint8_t const order_priority;
+        bool armed = false;
+        counted_method<T, irq_handler_t> handler;
+};
+
+/**
+ * @brief Owns the GPIO IRQ callback for some events on one pin.
+ *
+ * The SDK has a single GPIO callback per core, so there can only be one of these per core at a time.
+ */
+template<typename T>
+struct gpio_irq_registration
+{
+        gpio_irq_registration(T& self, void (T::*method)(uint, uint32_t), uint gpio, uint32_t event_mask)
+            : gpio { gpio }, event_mask { event_mask }, handler { self, method }
+        {
+            handler.reopen();
+            gpio_set_irq_enabled_with_callback(gpio, event_mask, true, handler.get_callback());
+        }
+        ~gpio_irq_registration()
+        {
+            disarm();
+            handler.release();
+            gpio_set_irq_callback(nullptr);
+        }
+
+        gpio_irq_registration(const gpio_irq_registration&) = delete;
+        gpio_irq_registration& operator=(const gpio_irq_registration&) = delete;
+
+        /**
+         * @brief Enables the events again.
+         */
+        void rearm()
+        {
+            handler.reopen();
+            gpio_set_irq_enabled(gpio, event_mask, true);
+        }
+        /**
+         * @brief Disables the events and turns away any call still arriving on this core.
+         */
+        void disarm()
+        {
+            gpio_set_irq_enabled(gpio, event_mask, false);
+            handler.quiesce();
+        }
+
+    private:
+        uint const gpio;
+        uint32_t const event_mask;
+        counted_method<T, gpio_irq_callback_t> handler;
+};
+
+/**
+ * @brief Owns a repeating timer on the default alarm pool.
+ *
+ * The method returns false to stop the timer, same as the callback it replaces; rearm() starts it again.
+ * The default pool's alarms fire on the core that set it up, usually core 0, so that's where to construct, rearm and disarm it.
+ */
+template<typename T>
+struct repeating_timer_registration
+{
+        /**
+         * @param delay_us As for add_repeating_timer_us: negative times from the start of one call to the start of the next.
+         */
+        repeating_timer_registration(T& self, bool (T::*method)(repeating_timer_t*), int64_t delay_us)
+            : delay_us { delay_us }, handler { self, method }
+        {
+            rearm();
+        }
+        ~repeating_timer_registration()
+        {
+            disarm();
+            handler.release();
+        }
+
+        repeating_timer_registration(const repeating_timer_registration&) = delete;
+        repeating_timer_registration& operator=(const repeating_timer_registration&) = delete;
+
+        /**
+         * @brief (Re)starts the timer with the same delay, counting from now.
+         *
+         * @return False if the alarm pool had no room.
+         */
+        bool rearm()
+        {
+            cancel_repeating_timer(&timer);
+            handler.reopen();
+            return add_repeating_timer_us(delay_us, handler.get_callback(), nullptr, &timer);
+        }
+        /**
+         * @brief Restarts the timer with a new delay.
+         */
+        bool rearm(int64_t new_delay_us)
+        {
+            delay_us = new_delay_us;
+            return rearm();
+        }
+        /**
+         * @brief Stops the timer and turns away any call still arriving on this core.
+         */
+        void disarm()
+        {
+            cancel_repeating_timer(&timer);
+            handler.quiesce();
+        }
+
+    private:
+        int64_t delay_us;
+        repeating_timer_t timer { };
+        counted_method<T, repeating_timer_callback_t> handler;
+};
+
+/**
+ * @brief Owns the callback of a hardware alarm, which the caller has already claimed.
+ *
+ * Nothing fires until rearm() sets a target.
+ */
+template<typename T>
+struct hardware_alarm_registration
+{
+        hardware_alarm_registration(T& self, void (T::*method)(uint), uint alarm_num)
+            : alarm_num { alarm_num }, handler { self, method }
+        {
+            hardware_alarm_set_callback(alarm_num, handler.get_callback());
+        }
+        ~hardware_alarm_registration()
+        {
+            disarm();
+            handler.release();
+            hardware_alarm_set_callback(alarm_num, nullptr);
+        }
+
+        hardware_alarm_registration(const hardware_alarm_registration&) = delete;
+        hardware_alarm_registration& operator=(const hardware_alarm_registration&) = delete;
+
+        /**
+         * @brief Sets the alarm to fire at target.
+         *
+         * @return True if target was already in the past, in which case it doesn't fire.
+         */
+        bool rearm(absolute_time_t target)
+        {
+            handler.reopen();
+            return hardware_alarm_set_target(alarm_num, target);
+        }
+        /**
+         * @brief Cancels a pending alarm and turns away any call still arriving on this core.
+         */
+        void disarm()
+        {
+            hardware_alarm_cancel(alarm_num);
+            handler.quiesce();
+        }
+
+    private:
+        uint const alarm_num;
+        counted_method<T, hardware_alarm_callback_t> handler;
+};
+
+#endif /* PICO_REGISTRATION_H */
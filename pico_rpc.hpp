@@ -0,0 +1,370 @@
+#ifndef PICO_RPC_H
+#define PICO_RPC_H
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+#include "bound_trampoline.hpp"
+
+/**
+ * @brief Calls between the two cores over the SIO FIFOs, landing in whatever a slot number is bound to.
+ *
+ * Slots hold ordinary callbacks, typically trampolines to member functions, so a call on one core runs
+ * `object.method(a, b, c)` on the other:
+ * @code
+ * c_trampoline<mixer, uint32_t, uint32_t, uint32_t, uint32_t> set_gain_call { the_mixer, &mixer::set_gain };
+ * rpc_channel<> rpc;
+ * rpc.serve(5, set_gain_call);
+ * rpc.listen();                             // on the core that runs the calls
+ * rpc.post(5, channel, gain);               // from the other core, fire and forget
+ * uint32_t old = rpc.call(5, 2, 10).get();  // or wait for the result
+ * @endcode
+ *
+ * A call is one header word, {type, future, argc, slot} from the top byte down, followed by its arguments.
+ * The receiving core's SIO IRQ handler, a bound_trampoline with the core number baked in, runs every
+ * message waiting in the FIFO before returning, so a burst of calls costs one interrupt.
+ * Results come back the same way to whichever future asked for them.
+ *
+ * Messages go out with interrupts masked so they can't interleave. If the FIFO fills up meanwhile, the sender
+ * runs incoming calls itself rather than wait on a core that might be waiting on it; their replies are held
+ * until the message is out, and any post() or call() they make themselves is refused (post() returns false,
+ * call() an invalid future), since its words would land in the middle of the message. Either way, a call may
+ * run with interrupts masked, so keep procedures short.
+ *
+ * Only 32-bit words cross the FIFO, so arguments are at most 4 bytes; on a 64-bit host that rules out pointers.
+ *
+ * @tparam Slots Size of the slot table.
+ * @tparam Futures Calls each core can have waiting for a result at once.
+ */
+template<size_t Slots = 32, size_t Futures = 8>
+requires (Slots > 0 && Slots <= 256) && (Futures > 0 && Futures < 256)
+struct rpc_channel
+{
+        typedef uint32_t (*procedure)(uint32_t, uint32_t, uint32_t);
+        /**
+         * @brief Result of calling a slot nothing is bound to.
+         */
+        static constexpr uint32_t unknown = UINT32_MAX;
+
+        /**
+         * @brief Running totals for one core, for working out throughput and how well calls batch.
+         *
+         * bench/rpc.cpp uses these alongside its own timing of round trips and bursts.
+         */
+        struct statistics
+        {
+            uint32_t sent = 0; // calls this core made
+            uint32_t served = 0; // calls this core ran
+            uint32_t interrupts = 0; // SIO IRQs taken; served / interrupts is the average batch
+            uint32_t stalls = 0; // times a send found the FIFO full
+            uint32_t refused = 0; // sends made by calls run during a stall, and turned away
+            uint32_t errors = 0; // malformed messages, after which the FIFO was flushed
+        };
+
+        /**
+         * @brief The result of a call, once it arrives.
+         *
+         * Dropping a future before then is fine; the result is thrown away when it turns up.
+         */
+        struct future
+        {
+                future(future&& other) : channel { other.channel }, core { other.core }, id { other.id }
+                {
+                    other.id = 0;
+                }
+                future(const future&) = delete;
+                future& operator=(const future&) = delete;
+                ~future()
+                {
+                    if (id)
+                        channel->abandon(core, id);
+                }
+
+                /**
+                 * @brief False if the call wasn't made: every future was in use, or it was refused during a stall.
+                 */
+                bool valid() const
+                {
+                    return id != 0;
+                }
+                bool ready() const
+                {
+                    return id && channel->futures[core][id - 1].state == ready_state;
+                }
+                /**
+                 * @brief Waits for the result, serving incoming calls meanwhile so it works from any context.
+                 */
+                uint32_t get()
+                {
+                    if (!id)
+                        return unknown;
+                    while (!ready())
+                        channel->poll();
+                    uint32_t value = channel->futures[core][id - 1].value;
+                    channel->abandon(core, id);
+                    id = 0;
+                    return value;
+                }
+
+            private:
+                friend struct rpc_channel;
+                future(rpc_channel* channel, uint8_t core, uint8_t id) : channel { channel }, core { core }, id { id } { }
+                rpc_channel* channel;
+                uint8_t core;
+                uint8_t id;
+        };
+
+        rpc_channel() = default;
+        ~rpc_channel()
+        {
+            for (uint core = 0; core < 2; core++)
+                if (listening[core])
+                {
+                    irq_set_enabled(SIO_IRQ_PROC0 + core, false);
+                    irq_remove_handler(SIO_IRQ_PROC0 + core, handlers[core]);
+                }
+        }
+
+        rpc_channel(const rpc_channel&) = delete;
+        rpc_channel& operator=(const rpc_channel&) = delete;
+
+        /**
+         * @brief Starts running calls (and collecting results) on the calling core.
+         *
+         * Both cores need to listen if both make calls that return results.
+         */
+        void listen()
+        {
+            uint core = get_core_num();
+            multicore_fifo_drain();
+            multicore_fifo_clear_irq();
+            irq_set_exclusive_handler(SIO_IRQ_PROC0 + core, handlers[core]);
+            irq_set_enabled(SIO_IRQ_PROC0 + core, true);
+            listening[core] = true;
+        }
+
+        /**
+         * @brief Binds slot to call; a single word store, so it can change while calls are arriving.
+         */
+        void serve(uint8_t slot, procedure call)
+        {
+            if (slot < Slots)
+                table[slot] = call;
+        }
+
+        /**
+         * @brief Runs slot on the other core without waiting for it.
+         *
+         * @return False if this came from a call run while this core was stalled partway through sending.
+         */
+        template<FitsInRegister... A>
+        requires NotTooManyArgs<3, A...> && ((sizeof(A) <= sizeof(uint32_t)) && ...)
+        bool post(uint8_t slot, A... args)
+        {
+            return send_call(slot, 0, { uint32_t(register_word(args))... });
+        }
+        /**
+         * @brief Runs slot on the other core, returning a future for its result.
+         *
+         * The future is invalid if every future was in use, or if post() would have returned false.
+         */
+        template<FitsInRegister... A>
+        requires NotTooManyArgs<3, A...> && ((sizeof(A) <= sizeof(uint32_t)) && ...)
+        future call(uint8_t slot, A... args)
+        {
+            uint8_t core = get_core_num();
+            uint8_t id = claim(core);
+            if (id && !send_call(slot, id, { uint32_t(register_word(args))... }))
+            {
+                futures[core][id - 1].state = free_state;
+                id = 0;
+            }
+            return future { this, core, id };
+        }
+
+        /**
+         * @brief Runs anything waiting in this core's FIFO, for cores that don't listen() or have interrupts masked.
+         */
+        void poll()
+        {
+            uint core = get_core_num();
+            uint32_t status = save_and_disable_interrupts();
+            receive(core);
+            flush_replies(core);
+            restore_interrupts(status);
+        }
+
+        const statistics& stats(uint core) const
+        {
+            return counters[core];
+        }
+
+    private:
+        static constexpr uint32_t call_type = 0xCA;
+        static constexpr uint32_t reply_type = 0x5E;
+        static constexpr uint32_t header(uint32_t type, uint32_t future, uint32_t argc, uint32_t slot)
+        {
+            return type << 24 | future << 16 | argc << 8 | slot;
+        }
+
+        enum future_state : uint8_t { free_state, waiting_state, ready_state, abandoned_state };
+        struct future_slot
+        {
+            future_state volatile state = free_state;
+            uint32_t volatile value = 0;
+        };
+        struct reply
+        {
+            uint8_t id;
+            uint32_t value;
+        };
+
+        procedure volatile table[Slots] = { };
+        future_slot futures[2][Futures];
+        // Replies to calls run while this core was partway through sending; at most one per future the other core has.
+        reply held[2][Futures] = { };
+        size_t held_count[2] = { };
+        // Messages this core is partway through sending: more than one only while a stall runs incoming calls.
+        uint8_t sending[2] = { };
+        bool listening[2] = { };
+        statistics counters[2];
+        bound_trampoline<rpc_channel, void(), uint32_t> handlers[2] = { { *this, &rpc_channel::on_fifo_irq, 0 }, { *this, &rpc_channel::on_fifo_irq, 1 } };
+
+        void on_fifo_irq(uint32_t core)
+        {
+            counters[core].interrupts++;
+            multicore_fifo_clear_irq();
+            receive(core);
+        }
+
+        uint8_t claim(uint core)
+        {
+            uint32_t status = save_and_disable_interrupts();
+            uint8_t id = 0;
+            for (size_t i = 0; i < Futures && !id; i++)
+                if (futures[core][i].state == free_state)
+                {
+                    futures[core][i].state = waiting_state;
+                    id = i + 1;
+                }
+            restore_interrupts(status);
+            return id;
+        }
+        void abandon(uint core, uint8_t id)
+        {
+            uint32_t status = save_and_disable_interrupts();
+            future_slot& f = futures[core][id - 1];
+            f.state = f.state == waiting_state ? abandoned_state : free_state;
+            restore_interrupts(status);
+        }
+
+        bool send_call(uint8_t slot, uint8_t future, std::initializer_list<uint32_t> args)
+        {
+            uint core = get_core_num();
+            uint32_t status = save_and_disable_interrupts();
+            bool refused = sending[core] != 0;
+            if (refused)
+                counters[core].refused++;
+            else
+            {
+                sending[core]++;
+                transmit(core, header(call_type, future, args.size(), slot));
+                for (uint32_t word : args)
+                    transmit(core, word);
+                sending[core]--;
+                counters[core].sent++;
+                flush_replies(core);
+            }
+            restore_interrupts(status);
+            return !refused;
+        }
+        /**
+         * @brief Pushes one word, running incoming calls while the FIFO is full.
+         *
+         * Interrupts must be masked, and sending[core] raised for the whole message, so that what those calls
+         * try to send is held or refused instead of going out between this message's words.
+         */
+        void transmit(uint core, uint32_t word)
+        {
+            if (!multicore_fifo_wready())
+                counters[core].stalls++;
+            while (!multicore_fifo_wready())
+                receive(core);
+            multicore_fifo_push_blocking(word);
+        }
+        /**
+         * @brief Sends the held replies, unless this core is partway through a message, whose sender does it after.
+         */
+        void flush_replies(uint core)
+        {
+            if (sending[core])
+                return;
+            sending[core]++;
+            while (held_count[core])
+            {
+                reply r = held[core][--held_count[core]];
+                transmit(core, header(reply_type, r.id, 1, 0));
+                transmit(core, r.value);
+            }
+            sending[core]--;
+        }
+
+        /**
+         * @brief Handles every message waiting in this core's FIFO.
+         *
+         * Each message is read with interrupts masked, so a send from a higher priority that finds the FIFO
+         * full and calls this too can't take the second half of a message this one has started on.
+         */
+        void receive(uint core)
+        {
+            for (;;)
+            {
+                uint32_t status = save_and_disable_interrupts();
+                if (!multicore_fifo_rvalid())
+                {
+                    restore_interrupts(status);
+                    return;
+                }
+                uint32_t word = multicore_fifo_pop_blocking();
+                uint32_t type = word >> 24;
+                uint8_t id = word >> 16;
+                uint32_t argc = (word >> 8) & 0xFF;
+                uint8_t slot = word;
+                if ((type != call_type && type != reply_type) || argc > 3 || (id && id > Futures) || (type == reply_type && (argc != 1 || !id)))
+                {
+                    counters[core].errors++;
+                    multicore_fifo_drain();
+                    restore_interrupts(status);
+                    return;
+                }
+                uint32_t args[3] = { };
+                for (uint32_t i = 0; i < argc; i++)
+                    args[i] = multicore_fifo_pop_blocking();
+                if (type == reply_type)
+                {
+                    future_slot& f = futures[core][id - 1];
+                    if (f.state == waiting_state)
+                    {
+                        f.value = args[0];
+                        f.state = ready_state;
+                    }
+                    else if (f.state == abandoned_state)
+                        f.state = free_state;
+                    restore_interrupts(status);
+                    continue;
+                }
+                counters[core].served++;
+                restore_interrupts(status);
+
+                procedure call = slot < Slots ? table[slot] : nullptr;
+                uint32_t value = call ? call(args[0], args[1], args[2]) : unknown;
+                if (!id)
+                    continue;
+                status = save_and_disable_interrupts();
+                held[core][held_count[core]++] = { id, value };
+                flush_replies(core);
+                restore_interrupts(status);
+            }
+        }
+};
+
+#endif /* PICO_RPC_H */
@@ -0,0 +1,175 @@
+#ifndef PICO_SVC_H
+#define PICO_SVC_H
+#include "hardware/exception.h"
+#include "c_trampoline.hpp"
+
+/**
+ * @brief The registers the core stacks on exception entry, which is where an SVC's arguments and result live.
+ *
+ * Word-sized, which on the target is 32 bits; on the host it lets pc hold a real address.
+ */
+struct svc_frame
+{
+    uintptr_t r0, r1, r2, r3, r12, lr, pc, xpsr;
+};
+
+#ifndef __thumb__
+namespace c_trampoline_host
+{
+    /**
+     * @brief Frame of the svc_call in progress, standing in for both stacks on the host.
+     */
+    inline svc_frame* svc_frame_in_progress = nullptr;
+}
+#endif /* __thumb__ */
+
+/**
+ * @brief Supervisor call handler that dispatches `svc #n` through a table instead of a switch.
+ *
+ * Each entry is an ordinary callback pointer, typically from a c_trampoline<T, uint32_t, uint32_t, uint32_t, uint32_t>,
+ * so system calls land directly in member functions of whichever object implements them:
+ * @code
+ * struct scheduler
+ * {
+ *     c_trampoline<scheduler, uint32_t, uint32_t, uint32_t, uint32_t> yield_call { *this, &scheduler::yield };
+ *     uint32_t yield(uint32_t, uint32_t, uint32_t);
+ * };
+ * svc_dispatcher<16> syscalls;
+ * syscalls.set(3, the_scheduler.yield_call);
+ * uint32_t result = svc_call<3>(a, b, c);
+ * @endcode
+ *
+ * The caller's r0-r2 are passed through and the return value goes back in its r0.
+ * The handler is installed by the constructor and the previous one put back by the destructor.
+ *
+ * Finding the caller's registers needs the stack pointer and EXC_RETURN as they were on entry, which C++ can't
+ * get at, so the thunk passes sp and lr along as arguments; it's checked by thumb_model like the others.
+ *
+ * @tparam Count Number of table entries; numbers past the end, like empty entries, return unknown.
+ */
+template<size_t Count = 256>
+requires (Count > 0 && Count <= 256)
+struct C_TRAMPOLINE_LAYOUT(4) svc_dispatcher
+{
+        typedef uint32_t (*syscall)(uint32_t, uint32_t, uint32_t);
+        /**
+         * @brief What a call to an empty entry returns.
+         */
+        static constexpr uint32_t unknown = UINT32_MAX;
+
+        svc_dispatcher()
+            : self { this }, target { reinterpret_cast<uintptr_t>(&dispatch) }
+        {
+#ifdef __thumb__
+            static_assert(offsetof(svc_dispatcher, self) == Code::literals_at);
+            static_assert(offsetof(svc_dispatcher, target) == Code::target_at);
+            previous = exception_set_exclusive_handler(SVCALL_EXCEPTION, reinterpret_cast<exception_handler_t>((uint8_t*)&asm_code + 1));
+#else
+            previous = exception_set_exclusive_handler(SVCALL_EXCEPTION, host_slot.get(this, &host_invoke));
+#endif /* __thumb__ */
+        }
+        ~svc_dispatcher()
+        {
+            exception_restore_handler(SVCALL_EXCEPTION, previous);
+        }
+
+        svc_dispatcher(const svc_dispatcher&) = delete;
+        svc_dispatcher& operator=(const svc_dispatcher&) = delete;
+
+        /**
+         * @brief Routes `svc #number` to call; a single word store, so it can be changed while calls are happening.
+         */
+        void set(uint8_t number, syscall call)
+        {
+            if (number < Count)
+                table[number] = call;
+        }
+        void clear(uint8_t number)
+        {
+            set(number, nullptr);
+        }
+        syscall get(uint8_t number) const
+        {
+            return number < Count ? table[number] : nullptr;
+        }
+
+    private:
+        /**
+         * @brief self in r0, the stack pointer in r1, and EXC_RETURN (lr) in r2.
+         */
+        struct svc_entry
+        {
+            static constexpr size_t incoming = 0;
+            static constexpr size_t literals = 1;
+            static constexpr thumb_asm::source sources[] = { thumb_asm::bound(0), thumb_asm::entry_register(thumb_asm::sp), thumb_asm::entry_register(thumb_asm::lr) };
+        };
+        typedef adapter_code<svc_entry> Code;
+
+        static void dispatch(svc_dispatcher* self, svc_frame* msp, uint32_t exc_return)
+        {
+            // Bit 2 of EXC_RETURN says which stack the caller was using.
+            svc_frame* frame = msp;
+            if (exc_return & 4)
+                frame = process_stack();
+            uint8_t number = reinterpret_cast<const uint16_t*>(frame->pc)[-1] & 0xFF;
+            syscall call = number < Count ? self->table[number] : nullptr;
+            frame->r0 = call ? call(frame->r0, frame->r1, frame->r2) : unknown;
+        }
+
+        Code asm_code;
+        svc_dispatcher* const self; // DO NOT change the order of this member or asm_code will be invalid!
+        uintptr_t const target; // DO NOT change the order of this member or asm_code will be invalid!
+        exception_handler_t previous;
+        syscall volatile table[Count] = { };
+
+#ifdef __thumb__
+        static svc_frame* process_stack()
+        {
+            svc_frame* psp;
+            __asm volatile ("mrs %0, psp" : "=r" (psp));
+            return psp;
+        }
+#else
+        static svc_frame* process_stack()
+        {
+            return c_trampoline_host::svc_frame_in_progress;
+        }
+        c_trampoline_host::slot<void> host_slot;
+        static void host_invoke(void* context)
+        {
+            dispatch(static_cast<svc_dispatcher*>(context), c_trampoline_host::svc_frame_in_progress, 0);
+        }
+#endif /* __thumb__ */
+
+    public:
+        /**
+         * @brief Cortex-M0+ cycles from the start of the handler to the branch into dispatch.
+         */
+        static constexpr unsigned thunk_cycles = Code::cycles;
+};
+
+/**
+ * @brief Makes supervisor call Number with up to three arguments and returns what the handler put in r0.
+ *
+ * On the host this builds the exception frame by hand and raises SVCall through the mock.
+ */
+template<uint8_t Number> inline uint32_t svc_call(uint32_t a = 0, uint32_t b = 0, uint32_t c = 0)
+{
+#ifdef __thumb__
+    register uint32_t r0 __asm("r0") = a;
+    register uint32_t r1 __asm("r1") = b;
+    register uint32_t r2 __asm("r2") = c;
+    __asm volatile ("svc %[number]" : "+r" (r0) : "r" (r1), "r" (r2), [number] "I" (Number) : "memory");
+    return r0;
+#else
+    static const uint16_t instruction[2] = { uint16_t(0xDF00 | Number), thumb_asm::nop() };
+    svc_frame frame { a, b, c, 0, 0, 0, reinterpret_cast<uintptr_t>(&instruction[1]), 0 };
+    svc_frame* outer = c_trampoline_host::svc_frame_in_progress;
+    c_trampoline_host::svc_frame_in_progress = &frame;
+    pico_mock::raise_exception(SVCALL_EXCEPTION);
+    c_trampoline_host::svc_frame_in_progress = outer;
+    return frame.r0;
+#endif /* __thumb__ */
+}
+
+#endif /* PICO_SVC_H */
@@ -0,0 +1,146 @@
+#ifndef PICO_SWIRQ_H
+#define PICO_SWIRQ_H
+#include <array>
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "pico_trampoline.hpp"
+
+/**
+ * @brief Software interrupts: deferred work at several priorities, with the NVIC doing the scheduling.
+ *
+ * Each tier claims one of the spare user IRQs and drains its own queue of work items from that IRQ's handler,
+ * which is an irq_trampoline back into the tier. Posting an item queues it and pends the IRQ, so work posted
+ * to a higher tier preempts whatever lower tier (or thread code) is running, and work posted to a lower tier
+ * waits until everything above it has finished. That's priority-preemptive scheduling without an RTOS.
+ *
+ * Work items are plain `void (*)()`, so the natural thing to post is an irq_trampoline's callback:
+ * @code
+ * struct radio
+ * {
+ *     irq_trampoline<radio> process_packet_work { *this, &radio::process_packet };
+ *     void on_irq() { ack_hardware(); swirq.post(1, process_packet_work); }
+ * };
+ * swirq_scheduler<3> swirq;
+ * @endcode
+ *
+ * Tier 0 is the lowest priority. On the RP2040 only the top two bits of a priority count, so there are four
+ * distinct levels, and tiers sharing a level don't preempt each other.
+ *
+ * @warning Posting masks interrupts on the calling core only, so post from one core, the one that owns the scheduler.
+ *
+ * @tparam Tiers Number of priority levels, each taking a user IRQ.
+ * @tparam Depth Items each tier can hold; a power of two.
+ */
+template<size_t Tiers, size_t Depth = 16>
+requires (Tiers > 0 && Tiers <= NUM_USER_IRQS) && (Depth > 0 && (Depth & (Depth - 1)) == 0)
+struct swirq_scheduler
+{
+        typedef void (*work)();
+
+        /**
+         * @brief Tier i gets priority 0xC0 - 0x40 * i (or 0 past tier 3), so tier 0 is the lowest on the chip.
+         */
+        swirq_scheduler()
+        {
+            for (size_t i = 0; i < Tiers; i++)
+                tiers[i].start(uint8_t(i < 3 ? 0xC0 - 0x40 * i : 0));
+        }
+        /**
+         * @param priorities Hardware priority for each tier, as for irq_set_priority.
+         */
+        swirq_scheduler(const std::array<uint8_t, Tiers>& priorities)
+        {
+            for (size_t i = 0; i < Tiers; i++)
+                tiers[i].start(priorities[i]);
+        }
+        ~swirq_scheduler()
+        {
+            for (tier& t : tiers)
+                t.stop();
+        }
+
+        swirq_scheduler(const swirq_scheduler&) = delete;
+        swirq_scheduler& operator=(const swirq_scheduler&) = delete;
+
+        /**
+         * @brief Queues item to run at tier level, from anywhere including interrupt handlers.
+         *
+         * @return False if the tier's queue is full (the item is dropped and counted) or there's no such tier.
+         */
+        bool post(size_t level, work item)
+        {
+            return level < Tiers && tiers[level].post(item);
+        }
+
+        /**
+         * @brief The user IRQ a tier runs on.
+         */
+        uint irq(size_t level) const
+        {
+            return tiers[level].irq;
+        }
+        /**
+         * @brief Items a tier has had to drop because its queue was full.
+         */
+        uint32_t overflows(size_t level) const
+        {
+            return tiers[level].overflows;
+        }
+
+    private:
+        struct tier
+        {
+            uint irq = 0;
+            work volatile queue[Depth] = { }; // volatile so the compiler keeps each access in order with head and tail
+            uint32_t volatile head = 0; // next to run, only moved by drain
+            uint32_t volatile tail = 0; // next free, only moved by post
+            uint32_t volatile overflows = 0;
+            irq_trampoline<tier> handler { *this, &tier::drain };
+
+            void start(uint8_t priority)
+            {
+                irq = user_irq_claim_unused(true);
+                irq_set_priority(irq, priority);
+                irq_set_exclusive_handler(irq, handler);
+                irq_set_enabled(irq, true);
+            }
+            void stop()
+            {
+                irq_set_enabled(irq, false);
+                irq_remove_handler(irq, handler);
+                user_irq_unclaim(irq);
+            }
+
+            bool post(work item)
+            {
+                uint32_t status = save_and_disable_interrupts();
+                bool queued = tail - head < Depth;
+                if (queued)
+                {
+                    queue[tail % Depth] = item;
+                    tail = tail + 1;
+                }
+                else
+                    overflows = overflows + 1;
+                restore_interrupts(status);
+                if (queued)
+                    irq_set_pending(irq);
+                return queued;
+            }
+            /**
+             * @brief Runs everything queued, including anything posted while it's running.
+             */
+            void drain()
+            {
+                while (head != tail)
+                {
+                    work item = queue[head % Depth];
+                    head = head + 1;
+                    item();
+                }
+            }
+        };
+        std::array<tier, Tiers> tiers;
+};
+
+#endif /* PICO_SWIRQ_H */
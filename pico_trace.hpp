@@ -0,0 +1,334 @@
+#ifndef PICO_TRACE_H
+#define PICO_TRACE_H
+#include <string.h>
+#include <initializer_list>
+#include "hardware/sync.h"
+#include "pico/platform.h"
+#include "pico/time.h"
+#include "c_trampoline.hpp"
+#ifndef __thumb__
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#endif /* __thumb__ */
+
+/**
+ * @file
+ * @brief Recording what trampolines were called with, and when, so it can be replayed on the host.
+ *
+ * Bugs that depend on exactly when an interrupt arrived and what it said don't reproduce on a desk.
+ * A recording_trampoline is a drop-in for a c_trampoline that first appends a record to a trace_log,
+ * so the log ends up holding every call in order. Copy the log off the device however suits, then
+ * hand it to a trace_replayer on the host, which calls the same methods (built against host/pico_mock.hpp)
+ * with the same arguments, in the same IRQ context, at the recorded pace or faster:
+ * @code
+ * alignas(4) uint8_t trace_buffer[8192];
+ * trace_log trace { trace_buffer, sizeof(trace_buffer) };
+ * recording_trampoline<uart_driver, void()> uart_irq { trace, 1, the_uart, &uart_driver::on_irq };
+ * irq_set_exclusive_handler(UART0_IRQ, uart_irq);
+ * @endcode
+ * and on the host, bound to a plain trampoline so the replay isn't recorded all over again:
+ * @code
+ * c_trampoline<uart_driver, void> uart_replay { the_uart, &uart_driver::on_irq };
+ * trace_replayer replayer;
+ * replayer.bind(1, uart_replay.get_callback());
+ * trace_replayer::result r = replayer.replay(saved, saved_size, 10.0); // ten times as fast
+ * @endcode
+ * Binding the recording_trampoline itself works too, as long as its log has set_recording(false) for the replay.
+ *
+ * Each record is trace::header followed by its arguments as words, all little endian:
+ * 8 bytes plus 4 per argument. Arguments are recorded as register_word would pass them, so pointers
+ * are recorded but mean nothing once replayed somewhere else.
+ */
+namespace trace
+{
+    struct header
+    {
+        /**
+         * @brief time_us_32() when the call came in.
+         */
+        uint32_t time_us;
+        /**
+         * @brief Which trampoline, as given to its constructor.
+         */
+        uint16_t id;
+        /**
+         * @brief __get_current_exception(): 0 in thread mode, 16 + n in IRQ n.
+         */
+        uint8_t exception;
+        /**
+         * @brief Number of argument words following.
+         */
+        uint8_t argc;
+    };
+    static_assert(sizeof(header) == 8);
+}
+
+/**
+ * @brief An append-only binary log of calls, in a buffer supplied by the caller.
+ *
+ * Appending masks interrupts on the calling core for the copy, so records from handlers that preempt
+ * each other don't interleave. When it's full, further records are dropped and counted rather than
+ * overwriting what's there, since the start of a trace is what a replay needs.
+ */
+struct trace_log
+{
+        /**
+         * @param buffer Where records go; word aligned.
+         */
+        trace_log(void* buffer, size_t bytes) : buffer { static_cast<uint8_t*>(buffer) }, capacity { bytes } { }
+
+        trace_log(const trace_log&) = delete;
+        trace_log& operator=(const trace_log&) = delete;
+
+        /**
+         * @return False if the record didn't fit (it's counted in dropped()) or recording is paused.
+         */
+        bool append(uint16_t id, std::initializer_list<uint32_t> args)
+        {
+            if (!recording)
+                return false;
+            trace::header h { time_us_32(), id, uint8_t(__get_current_exception()), uint8_t(args.size()) };
+            size_t bytes = sizeof(h) + args.size() * sizeof(uint32_t);
+            uint32_t status = save_and_disable_interrupts();
+            bool fits = capacity - used >= bytes;
+            if (fits)
+            {
+                memcpy(buffer + used, &h, sizeof(h));
+                size_t at = used + sizeof(h);
+                for (uint32_t word : args)
+                {
+                    memcpy(buffer + at, &word, sizeof(word));
+                    at += sizeof(word);
+                }
+                used = at;
+            }
+            else
+                lost = lost + 1;
+            restore_interrupts(status);
+            return fits;
+        }
+
+        /**
+         * @brief Stops or restarts recording, e.g. to freeze the trace as soon as a fault is noticed.
+         */
+        void set_recording(bool on)
+        {
+            recording = on;
+        }
+        void clear()
+        {
+            uint32_t status = save_and_disable_interrupts();
+            used = 0;
+            lost = 0;
+            restore_interrupts(status);
+        }
+
+        const uint8_t* data() const
+        {
+            return buffer;
+        }
+        /**
+         * @brief Bytes of complete records in data().
+         */
+        size_t size() const
+        {
+            return used;
+        }
+        /**
+         * @brief Records that didn't fit.
+         */
+        uint32_t dropped() const
+        {
+            return lost;
+        }
+
+    private:
+        uint8_t* const buffer;
+        size_t const capacity;
+        size_t volatile used = 0;
+        uint32_t volatile lost = 0;
+        bool volatile recording = true;
+};
+
+/**
+ * @brief A c_trampoline that records each call in a trace_log before making it.
+ *
+ * Costs the record (a few dozen cycles plus the copy) on top of the call, with interrupts masked for the copy.
+ *
+ * @tparam T Class the method belongs to.
+ * @tparam Callback C callback signature being served, e.g. void() for irq_handler_t.
+ */
+template<typename T, typename Callback> struct recording_trampoline;
+
+template<typename T, typename R, FitsInRegister... Args>
+requires RegisterReturn<R> && NotTooManyArgs<3, Args...>
+struct recording_trampoline<T, R(Args...)>
+{
+        typedef R (T::*member_function_pointer)(Args...);
+        typedef R (*function_pointer)(Args...);
+
+        /**
+         * @param log Where the calls are recorded.
+         * @param id What the records say this trampoline is; the replayer binds callbacks by it.
+         */
+        recording_trampoline(trace_log& log, uint16_t id, T& self, member_function_pointer method)
+            : log { log }, id { id }, self { &self }, method { method } { }
+
+        recording_trampoline(const recording_trampoline&) = delete;
+        recording_trampoline& operator=(const recording_trampoline&) = delete;
+
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        operator function_pointer() const
+        {
+            return get_callback();
+        }
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        function_pointer get_callback() const
+        {
+            return thunk.get_callback();
+        }
+
+        void set_method(member_function_pointer new_method)
+        {
+            method = new_method;
+        }
+        member_function_pointer get_method() const
+        {
+            return method;
+        }
+
+    private:
+        trace_log& log;
+        uint16_t const id;
+        T* const self;
+        member_function_pointer method;
+        c_trampoline<recording_trampoline, R, Args...> thunk { *this, &recording_trampoline::record };
+
+        R record(Args... args)
+        {
+            log.append(id, { uint32_t(register_word(args))... });
+            return (self->*method)(args...);
+        }
+};
+
+#ifndef __thumb__
+/**
+ * @brief Re-drives a recorded trace through host callbacks, under the mock's clock and NVIC.
+ *
+ * Calls recorded in IRQ n are made from inside pico_mock::as_irq(n), so priorities and anything
+ * they pend behave as they did; thread mode calls are made directly.
+ */
+struct trace_replayer
+{
+        struct result
+        {
+            size_t calls = 0;
+            /**
+             * @brief Records whose id had nothing bound, or whose argument count didn't match.
+             */
+            size_t skipped = 0;
+            /**
+             * @brief True if the log ended partway through a record.
+             */
+            bool truncated = false;
+            /**
+             * @brief Wall clock time spent replaying, for throughput.
+             */
+            double seconds = 0;
+        };
+
+        /**
+         * @brief Sends records with this id to callback, typically a c_trampoline for the method that recorded them.
+         */
+        template<typename R, typename... Args>
+        void bind(uint16_t id, R (*callback)(Args...))
+        {
+            handlers[id] = [callback](const uint32_t* words, size_t argc)
+            {
+                if (argc != sizeof...(Args))
+                    return false;
+                call(callback, words, std::index_sequence_for<Args...>());
+                return true;
+            };
+        }
+
+        /**
+         * @brief Replays every record in log.
+         *
+         * @param speed How many times faster than recorded to move the mock's clock between calls,
+         * or 0 to leave the clock alone and make the calls back to back, for benchmarking.
+         */
+        result replay(const void* log, size_t bytes, double speed = 1)
+        {
+            result r;
+            const uint8_t* at = static_cast<const uint8_t*>(log);
+            const uint8_t* end = at + bytes;
+            uint64_t start = time_us_64();
+            uint64_t elapsed = 0; // recorded microseconds since the first record
+            uint32_t last = 0;
+            auto began = std::chrono::steady_clock::now();
+            for (bool first = true; at < end; first = false)
+            {
+                trace::header h;
+                if (size_t(end - at) < sizeof(h))
+                {
+                    r.truncated = true;
+                    break;
+                }
+                memcpy(&h, at, sizeof(h));
+                if (size_t(end - at) < sizeof(h) + h.argc * sizeof(uint32_t))
+                {
+                    r.truncated = true;
+                    break;
+                }
+                uint32_t words[256];
+                memcpy(words, at + sizeof(h), h.argc * sizeof(uint32_t));
+                at += sizeof(h) + h.argc * sizeof(uint32_t);
+
+                if (!first)
+                    elapsed += uint32_t(h.time_us - last); // time_us_32 wraps every 71 minutes
+                last = h.time_us;
+                if (speed > 0)
+                {
+                    uint64_t due = start + uint64_t(elapsed / speed);
+                    uint64_t now = time_us_64();
+                    if (due > now)
+                        pico_mock::advance_us(due - now);
+                }
+
+                auto handler = handlers.find(h.id);
+                bool made = false;
+                if (handler != handlers.end())
+                {
+                    auto make = [&] { made = handler->second(words, h.argc); };
+                    if (h.exception >= 16 && h.exception < 16 + NUM_IRQS)
+                        pico_mock::as_irq(h.exception - 16, make);
+                    else
+                        make();
+                }
+                if (made)
+                    r.calls++;
+                else
+                    r.skipped++;
+            }
+            r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+            return r;
+        }
+
+    private:
+        std::unordered_map<uint16_t, std::function<bool(const uint32_t*, size_t)>> handlers;
+
+        template<typename R, typename... Args, size_t... I>
+        static void call(R (*callback)(Args...), const uint32_t* words, std::index_sequence<I...>)
+        {
+            callback(from_register_word<Args>(words[I])...);
+        }
+};
+#endif /* __thumb__ */
+
+#endif /* PICO_TRACE_H */
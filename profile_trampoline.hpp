@@ -0,0 +1,274 @@
+#ifndef PROFILE_TRAMPOLINE_H
+#define PROFILE_TRAMPOLINE_H
+#include <atomic>
+#include "c_trampoline.hpp"
+
+/**
+ * @brief A set of trampolines whose targets all switch together, with one pointer store.
+ *
+ * Retargeting dozens of handlers with set_method one at a time (say, going into low-power mode) leaves a
+ * window where some run the old behavior and some the new. Instead, each trampoline in a group gets a slot,
+ * and a profile is a table giving a method for every slot. The thunks look their target up through the group's
+ * pointer to the active profile, so activating another profile is a single aligned store and each call sees
+ * either the whole old profile or the whole new one:
+ * @code
+ * profile_group<> modes;
+ * profile_trampoline<radio, void()> radio_irq { modes, the_radio, &radio::on_irq };
+ * profile_trampoline<display, void()> vsync { modes, the_display, &display::on_vsync };
+ * profile_group<>::profile low_power;
+ * radio_irq.set(low_power, &radio::on_irq_sleeping);
+ * modes.fill_from_defaults(low_power);  // vsync keeps doing what it does by default
+ * modes.activate(low_power);
+ * @endcode
+ *
+ * The methods each trampoline is constructed with make up the group's defaults profile, which is active to begin with.
+ *
+ * @warning A call that has already loaded its target finishes on the old profile, so don't change a profile
+ * that might still be in use; build a new one and activate that.
+ *
+ * @tparam Slots Trampolines the group can hold, up to 32 (the offset has to fit in one ldr).
+ */
+template<size_t Slots = 32>
+requires (Slots > 0 && Slots <= 32)
+struct profile_group
+{
+        /**
+         * @brief Method code addresses, one per slot. Zero means the profile doesn't say.
+         */
+        struct profile
+        {
+            uintptr_t target[Slots] = { };
+        };
+
+        profile_group() = default;
+        profile_group(const profile_group&) = delete;
+        profile_group& operator=(const profile_group&) = delete;
+
+        /**
+         * @brief Switches every trampoline in the group over to p at once.
+         *
+         * @return False, leaving the active profile alone, if p is missing a method for any slot in use.
+         */
+        bool activate(const profile& p)
+        {
+            size_t used = claimed;
+            for (size_t i = 0; i < used; i++)
+                if (!p.target[i])
+                    return false;
+            // Everything written to p has to be visible before the pointer to it is.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            active = &p;
+            return true;
+        }
+        /**
+         * @brief Goes back to the methods the trampolines were constructed with.
+         */
+        void activate_defaults()
+        {
+            active = &defaults;
+        }
+        const profile& current() const
+        {
+            return *active;
+        }
+        /**
+         * @brief Copies the default method into every slot p doesn't say anything about.
+         */
+        void fill_from_defaults(profile& p) const
+        {
+            for (size_t i = 0; i < Slots; i++)
+                if (!p.target[i])
+                    p.target[i] = defaults.target[i];
+        }
+
+        /**
+         * @brief Slots handed out so far.
+         */
+        size_t size() const
+        {
+            return claimed;
+        }
+
+    private:
+        template<typename T, typename Callback, size_t S> friend struct profile_trampoline;
+
+        profile defaults;
+        const profile* volatile active = &defaults; // Loaded by the thunks, so it has to stay one aligned word.
+        size_t claimed = 0;
+
+        /**
+         * @brief Next free slot, or Slots if the group is full.
+         */
+        size_t claim()
+        {
+            return claimed < Slots ? claimed++ : Slots;
+        }
+};
+
+/**
+ * @brief The thunk for a profile_trampoline with Count incoming arguments and slot: self into r0, target from the active profile.
+ */
+template<size_t Count> struct table_call_code
+{
+    /**
+     * @brief Halfwords of code, padded so the literals stay word aligned.
+     */
+    static constexpr size_t length = (Count + (Count < 3 ? 5 : 6) + 1) & ~size_t { 1 };
+    static constexpr size_t self_at = length * 2;
+    static constexpr size_t variable_at = self_at + sizeof(uint32_t);
+
+    static constexpr thumb_asm::code<length> assemble(size_t slot)
+    {
+        thumb_asm::code<length> c;
+        thumb_asm::assemble_table_call(c, Count, slot, self_at, variable_at);
+        return c;
+    }
+    static_assert(assemble(0).size == length && !assemble(0).failed && assemble(31).size == length && !assemble(31).failed, "Thunk failed to assemble.");
+    static_assert(thumb_model::fuzz_table_call(assemble(0).op, Count, 0, 32) && thumb_model::fuzz_table_call(assemble(31).op, Count, 31, 32),
+        "Thunk differs from calling the profile's entry directly.");
+    static_assert(thumb_model::activate_race(assemble(0).op, 0).clean() && thumb_model::activate_race(assemble(31).op, 31).clean(),
+        "A call racing activate can mix two profiles.");
+
+    /**
+     * @brief Cortex-M0+ cycles from the first instruction up to and including the branch to the target.
+     */
+    static constexpr unsigned cycles = []
+    {
+        uint32_t memory[2] = { 4, 1 };
+        return thumb_model::run_table_call(assemble(0).op, 0, memory, 0, { }).cycles;
+    }();
+
+    uint16_t volatile __attribute__((aligned(4))) code[length];
+
+    /**
+     * @param slot Slot to load; 32 and up assemble to a udf, so calling it traps.
+     */
+    constexpr table_call_code(size_t slot) : table_call_code(assemble(slot), std::make_index_sequence<length>()) { }
+    template<size_t... I> constexpr table_call_code(const thumb_asm::code<length>& c, std::index_sequence<I...>) : code { c.op[I]... } { }
+};
+
+/**
+ * @brief Adapts a non-static class method for use with a C callback, with the method taken from the group's active profile.
+ *
+ * Costs one slot in the group, which isn't given back until the group goes away, and two more loads per call than a c_trampoline.
+ * Virtual methods can't go in a profile, since a profile holds code addresses.
+ *
+ * @warning Same caveats as c_trampoline, and the group must outlive it.
+ *
+ * @tparam T Class the method belongs to.
+ * @tparam Callback C callback signature being served, e.g. void() for irq_handler_t.
+ * @tparam Slots Size of the group.
+ */
+template<typename T, typename Callback, size_t Slots = 32> struct profile_trampoline;
+
+template<typename T, typename R, FitsInRegister... Args, size_t Slots>
+requires RegisterReturn<R> && NotTooManyArgs<3, Args...>
+struct C_TRAMPOLINE_LAYOUT(4) profile_trampoline<T, R(Args...), Slots>
+{
+        typedef R (T::*member_function_pointer)(Args...);
+        typedef R (*function_pointer)(Args...);
+        typedef profile_group<Slots> group_type;
+
+        /**
+         * @param group Group to join.
+         * @param self Object to bind this wrapper to.
+         * @param method What this calls under the group's defaults profile. If it's virtual, or the group is full,
+         * the trampoline is left invalid and traps when called.
+         */
+        profile_trampoline(group_type& group, T& self, member_function_pointer method)
+            : profile_trampoline(group, self, method, method_code_address(method) ? group.claim() : Slots)
+        {
+#ifdef __thumb__
+            static_assert(offsetof(profile_trampoline, self) == Code::self_at);
+            static_assert(offsetof(profile_trampoline, variable) == Code::variable_at);
+#endif /* __thumb__ */
+        }
+
+        profile_trampoline(const profile_trampoline&) = delete;
+        profile_trampoline& operator=(const profile_trampoline&) = delete;
+
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        operator function_pointer() const
+        {
+            return get_callback();
+        }
+        /**
+         * @brief Returns a function pointer that can be passed to whatever wants a legit callback.
+         */
+        function_pointer get_callback() const
+        {
+#ifdef __thumb__
+            return reinterpret_cast<function_pointer>((uint8_t*)&asm_code + 1); // Plus one to stay in Thumb mode.
+#else
+            return host_slot.get(const_cast<profile_trampoline*>(this), &host_invoke);
+#endif /* __thumb__ */
+        }
+
+        /**
+         * @brief Sets what this calls while p is active.
+         *
+         * @return False if the method is virtual or the group was already full when this was constructed.
+         */
+        bool set(typename group_type::profile& p, member_function_pointer method) const
+        {
+            uintptr_t address = method_code_address(method);
+            if (!valid() || !address)
+                return false;
+            p.target[slot] = address;
+            return true;
+        }
+
+        /**
+         * @brief This trampoline's entry in the group's profiles.
+         */
+        size_t slot_index() const
+        {
+            return slot;
+        }
+
+        /**
+         * @brief False if the group was full or the method given to the constructor was virtual, in which case calling this traps.
+         */
+        bool valid() const
+        {
+            return slot < Slots;
+        }
+
+        /**
+         * @brief Cortex-M0+ cycles spent in the trampoline, from the first instruction up to and including the branch to the method.
+         */
+        static constexpr unsigned thunk_cycles = table_call_code<sizeof...(Args)>::cycles;
+
+    private:
+        typedef table_call_code<sizeof...(Args)> Code;
+
+        profile_trampoline(group_type& group, T& self, member_function_pointer method, size_t slot)
+            : asm_code { slot < Slots ? slot : 32 }, self { &self }, variable { &group.active }, slot { slot }
+        {
+            // A virtual method never got a slot, so this only fails when valid() already says so.
+            set(group.defaults, method);
+        }
+
+        Code asm_code;
+        T* const self; // DO NOT change the order of this member or asm_code will be invalid!
+        const typename group_type::profile* volatile const* const variable; // DO NOT change the order of this member or asm_code will be invalid!
+        size_t const slot;
+#ifndef __thumb__
+        c_trampoline_host::slot<R, Args...> host_slot;
+        /**
+         * @brief Calls the code address with self as the first argument, which is how the Itanium C++ ABI passes this.
+         */
+        static R host_invoke(void* context, Args... args)
+        {
+            profile_trampoline& t = *static_cast<profile_trampoline*>(context);
+            if (!t.valid())
+                __builtin_trap(); // Where the Thumb thunk would hit its udf.
+            uintptr_t address = (*t.variable)->target[t.slot];
+            return reinterpret_cast<R (*)(T*, Args...)>(address)(t.self, args...);
+        }
+#endif /* __thumb__ */
+};
+
+#endif /* PROFILE_TRAMPOLINE_H */
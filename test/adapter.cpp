@@ -0,0 +1,56 @@
+/**
+ * @file
+ * @brief Host checks for adapter_trampoline: it accepts and rejects the same maps as the Thumb assembler.
+ *
+ * Exits non-zero, naming the failed check, if any of them fail.
+ *
+ * @code
+ * g++ -std=c++20 -I. -Ihost test/adapter.cpp -o adapter && ./adapter
+ * @endcode
+ */
+#include <stdio.h>
+#include "adapter_trampoline.hpp"
+
+using thumb_asm::arg;
+using thumb_asm::bound;
+
+static int failures = 0;
+#define CHECK(condition) ((condition) ? (void)0 : (void)(failures++, fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition)))
+
+static uintptr_t digits(uintptr_t a, uintptr_t b, uintptr_t c, uintptr_t d)
+{
+    return a * 1000 + b * 100 + c * 10 + d;
+}
+
+static uintptr_t pair(uintptr_t a, uintptr_t b)
+{
+    return a * 10 + b;
+}
+
+int main()
+{
+    // Four moves and nothing bound: no register is left to hold the target's address.
+    adapter_trampoline<uintptr_t(uintptr_t, uintptr_t, uintptr_t, uintptr_t)> shuffled { &digits, { arg(1), arg(0), arg(3), arg(2) } };
+    CHECK(!shuffled.ok());
+
+    // One of the four bound frees a register for it.
+    adapter_trampoline<uintptr_t(uintptr_t, uintptr_t, uintptr_t)> with_bound { &digits, { arg(1), arg(0), bound(0), arg(2) }, { 7 } };
+    CHECK(with_bound.ok());
+    CHECK(with_bound.ok() && with_bound.get_callback()(1, 2, 3) == 2173);
+
+    adapter_trampoline<uintptr_t(uintptr_t, uintptr_t)> swapped { &pair, { arg(1), arg(0) } };
+    CHECK(swapped.ok());
+    CHECK(swapped.ok() && swapped.get_callback()(1, 2) == 21);
+
+    // Out of range on either side.
+    adapter_trampoline<uintptr_t(uintptr_t)> missing_arg { &pair, { arg(0), arg(1) } };
+    CHECK(!missing_arg.ok());
+    adapter_trampoline<uintptr_t(uintptr_t)> missing_literal { &pair, { arg(0), bound(1) }, { 7 } };
+    CHECK(!missing_literal.ok());
+    adapter_trampoline<uintptr_t(uintptr_t)> wrong_count { &pair, { arg(0) } };
+    CHECK(!wrong_count.ok());
+
+    if (failures == 0)
+        puts("adapter: all passed");
+    return failures != 0;
+}
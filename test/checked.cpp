@@ -0,0 +1,70 @@
+/**
+ * @file
+ * @brief Host checks for C_TRAMPOLINE_CHECKED builds: constant-initialized trampolines get scanned too.
+ *
+ * Exits non-zero, naming the failed check, if any of them fail.
+ *
+ * @code
+ * g++ -std=c++20 -DC_TRAMPOLINE_CHECKED -I. -Ihost test/checked.cpp -o checked && ./checked
+ * @endcode
+ */
+#include <stdio.h>
+#include "c_trampoline.hpp"
+
+#ifndef C_TRAMPOLINE_CHECKED
+#error "Build with -DC_TRAMPOLINE_CHECKED."
+#endif /* C_TRAMPOLINE_CHECKED */
+
+static int failures = 0;
+#define CHECK(condition) ((condition) ? (void)0 : (void)(failures++, fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition)))
+
+struct counter
+{
+        uint32_t calls = 0;
+
+        void tick()
+        {
+            calls++;
+        }
+};
+
+counter the_counter;
+// A plain global: constant-initialized, so its constructor never runs.
+c_trampoline<counter, void> global_tick { the_counter, &counter::tick };
+constinit c_trampoline<counter, void> constinit_tick { the_counter, &counter::tick };
+
+static size_t live_count()
+{
+    size_t n = 0;
+    for (const c_trampoline_checked::node* i = c_trampoline_checked::live; i; i = i->next)
+        n++;
+    return n;
+}
+
+int main()
+{
+    CHECK(live_count() == 0);
+
+    void (*callback)() = global_tick.get_callback();
+    CHECK(live_count() == 1);
+    callback();
+    CHECK(the_counter.calls == 1);
+    // Asking again doesn't add it twice.
+    global_tick.get_callback();
+    CHECK(live_count() == 1);
+
+    constinit_tick.get_callback();
+    CHECK(live_count() == 2);
+    {
+        c_trampoline<counter, void> local_tick { the_counter, &counter::tick };
+        local_tick.get_callback()();
+        CHECK(live_count() == 3);
+        CHECK(the_counter.calls == 2);
+    }
+    CHECK(live_count() == 2);
+    CHECK(c_trampoline_checked::scan() == 0);
+
+    if (failures == 0)
+        puts("checked: all passed");
+    return failures != 0;
+}
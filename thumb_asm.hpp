@@ -0,0 +1,461 @@
+#ifndef THUMB_ASM_H
+#define THUMB_ASM_H
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief A constexpr encoder for the few Thumb instructions trampolines are built from.
+ *
+ * Literal offsets are computed from where the instruction and the literal actually are, so moving
+ * something in a thunk moves its offsets with it instead of silently breaking them.
+ * Anything that can't be encoded (an offset out of range or misaligned, a high register where only
+ * r0-r7 fit) calls one of the deliberately non-constexpr functions below, which turns into a compile
+ * error naming the problem when it happens during constant evaluation.
+ * The same encoders work at run time, where a bad encoding becomes a udf so it traps instead of running off somewhere.
+ */
+namespace thumb_asm
+{
+    enum reg : uint8_t { r0, r1, r2, r3, r4, r5, r6, r7, r8, r9, r10, r11, r12, sp, lr, pc };
+
+    /**
+     * @brief What a bad encoding turns into at run time: udf #0xFE.
+     */
+    constexpr uint16_t invalid = 0xDEFE;
+
+    // Not constexpr on purpose, see above.
+    inline uint16_t literal_out_of_range() { return invalid; }
+    inline uint16_t literal_misaligned() { return invalid; }
+    inline uint16_t branch_out_of_range() { return invalid; }
+    inline uint16_t not_a_low_register() { return invalid; }
+    inline uint16_t immediate_out_of_range() { return invalid; }
+    inline uint16_t code_too_long() { return invalid; }
+
+    /**
+     * @brief A 32-bit (Thumb-2) instruction, first halfword first.
+     */
+    struct wide
+    {
+        uint16_t first;
+        uint16_t second;
+    };
+
+    /**
+     * @brief Word alignment applied to PC for literal addressing.
+     *
+     * @param at Byte offset of the instruction reading the literal.
+     */
+    constexpr size_t literal_base(size_t at)
+    {
+        return (at + 4) & ~size_t { 3 };
+    }
+
+    /**
+     * @brief mov Rd, Rm (T1, any registers, flags unaffected)
+     */
+    constexpr uint16_t mov(reg d, reg m)
+    {
+        return 0x4600 | (d & 8) << 4 | m << 3 | (d & 7);
+    }
+
+    /**
+     * @brief ldr Rt, [pc, #imm] (T1)
+     *
+     * @param at Byte offset of this instruction.
+     * @param literal Byte offset of the word to load, relative to the same origin as at.
+     */
+    constexpr uint16_t ldr_literal(reg t, size_t at, size_t literal)
+    {
+        if (t > r7)
+            return not_a_low_register();
+        if (literal % 4)
+            return literal_misaligned();
+        if (literal < literal_base(at) || literal - literal_base(at) > 1020)
+            return literal_out_of_range();
+        return 0x4800 | t << 8 | (literal - literal_base(at)) / 4;
+    }
+
+    /**
+     * @brief movs Rd, #imm8 (T1)
+     */
+    constexpr uint16_t movs(reg d, unsigned imm)
+    {
+        if (d > r7)
+            return not_a_low_register();
+        if (imm > 255)
+            return immediate_out_of_range();
+        return 0x2000 | d << 8 | imm;
+    }
+
+    /**
+     * @brief adds Rd, Rn, Rm (T1)
+     */
+    constexpr uint16_t adds(reg d, reg n, reg m)
+    {
+        if (d > r7 || n > r7 || m > r7)
+            return not_a_low_register();
+        return 0x1800 | m << 6 | n << 3 | d;
+    }
+
+    /**
+     * @brief muls Rdm, Rn, Rdm (T1), single cycle on the RP2040.
+     */
+    constexpr uint16_t muls(reg dm, reg n)
+    {
+        if (dm > r7 || n > r7)
+            return not_a_low_register();
+        return 0x4340 | n << 3 | dm;
+    }
+
+    /**
+     * @brief ldr Rt, [Rn, #imm] (T1), imm a multiple of 4 up to 124.
+     */
+    constexpr uint16_t ldr_immediate(reg t, reg n, size_t offset)
+    {
+        if (t > r7 || n > r7)
+            return not_a_low_register();
+        if (offset % 4)
+            return literal_misaligned();
+        if (offset > 124)
+            return immediate_out_of_range();
+        return 0x6800 | (offset / 4) << 6 | n << 3 | t;
+    }
+
+    /**
+     * @brief ldr.w Rt, [pc, #+/-imm12] (T2).
+     *
+     * ARMv7-M and ARMv8-M mainline only (e.g. the RP2350's Cortex-M33), not the RP2040's ARMv6-M.
+     * With Rt = pc this loads the target and branches in one instruction.
+     */
+    constexpr wide ldr_w_literal(reg t, size_t at, size_t literal)
+    {
+        size_t base = literal_base(at);
+        bool add = literal >= base;
+        size_t offset = add ? literal - base : base - literal;
+        if (offset > 4095)
+            return { literal_out_of_range(), invalid };
+        return { uint16_t(0xF85F | add << 7), uint16_t(t << 12 | offset) };
+    }
+
+    /**
+     * @brief bx Rm
+     */
+    constexpr uint16_t bx(reg m)
+    {
+        return 0x4700 | m << 3;
+    }
+
+    /**
+     * @brief b label (T2, unconditional, +/-2 KB)
+     *
+     * @param at Byte offset of this instruction.
+     * @param target Byte offset to branch to, relative to the same origin as at.
+     */
+    constexpr uint16_t b(size_t at, size_t target)
+    {
+        ptrdiff_t offset = ptrdiff_t(target) - ptrdiff_t(at + 4);
+        if (offset % 2)
+            return literal_misaligned();
+        if (offset < -2048 || offset > 2046)
+            return branch_out_of_range();
+        return 0xE000 | (offset >> 1 & 0x7FF);
+    }
+
+    /**
+     * @brief nop
+     */
+    constexpr uint16_t nop()
+    {
+        return 0xBF00;
+    }
+
+    /**
+     * @brief udf #imm8, permanently undefined, so it always faults.
+     */
+    constexpr uint16_t udf(unsigned imm)
+    {
+        if (imm > 255)
+            return immediate_out_of_range();
+        return 0xDE00 | imm;
+    }
+
+    /**
+     * @brief bkpt #imm8
+     */
+    constexpr uint16_t bkpt(unsigned imm)
+    {
+        if (imm > 255)
+            return immediate_out_of_range();
+        return 0xBE00 | imm;
+    }
+
+    /**
+     * @brief A fixed-size buffer of opcodes being assembled.
+     *
+     * @tparam N Capacity in halfwords.
+     */
+    template<size_t N> struct code
+    {
+        uint16_t op[N] = { };
+        size_t size = 0;
+        /**
+         * @brief Set if anything failed to encode or didn't fit, for run-time callers.
+         */
+        bool failed = false;
+
+        /**
+         * @brief Byte offset of the next instruction, for the at parameter of the encoders.
+         */
+        constexpr size_t here() const
+        {
+            return size * 2;
+        }
+        constexpr void emit(uint16_t opcode)
+        {
+            if (size >= N)
+            {
+                code_too_long();
+                failed = true;
+                return;
+            }
+            if (opcode == invalid)
+                failed = true;
+            op[size++] = opcode;
+        }
+        constexpr void emit(wide opcode)
+        {
+            emit(opcode.first);
+            emit(opcode.second);
+        }
+        /**
+         * @brief Pads with a nop if needed so whatever follows the code is word aligned.
+         */
+        constexpr void align()
+        {
+            if (size % 2)
+                emit(nop());
+        }
+    };
+
+    /**
+     * @brief Where an outgoing argument register gets its value from.
+     */
+    struct source
+    {
+        enum kind_t : uint8_t { incoming, literal, machine } kind;
+        uint8_t index;
+    };
+    /**
+     * @brief The outgoing argument is incoming argument i, which arrived in ri.
+     */
+    constexpr source arg(unsigned i)
+    {
+        return { source::incoming, uint8_t(i) };
+    }
+    /**
+     * @brief The outgoing argument is bound literal i.
+     */
+    constexpr source bound(unsigned i)
+    {
+        return { source::literal, uint8_t(i) };
+    }
+
+    /**
+     * @brief The outgoing argument is whatever register r (r4 to lr) held when the thunk was entered, e.g. sp or lr.
+     */
+    constexpr source entry_register(reg r)
+    {
+        return { source::machine, uint8_t(r) };
+    }
+
+    /**
+     * @brief Assembles a thunk that fills r0 onwards from sources and then jumps to an address held in a literal.
+     *
+     * Register moves are ordered so nothing is overwritten before it's read, with r12 breaking any cycles.
+     * The target goes through a low register the call doesn't use if there is one, otherwise
+     * through r12 by way of a register that is about to be loaded with a literal anyway.
+     *
+     * @param sources One entry per outgoing argument register.
+     * @param count Number of outgoing arguments, at most four.
+     * @param incoming Number of incoming arguments, at most four.
+     * @param literals_at Byte offset of bound literal 0; bound literal i is at literals_at + 4i.
+     * @param target_at Byte offset of the literal holding the target address (with the Thumb bit set).
+     * @return False if it can't be done: too many arguments, an incoming argument or entry register out of range, or
+     * four outgoing registers that are all moves, which leaves nowhere to put the target.
+     */
+    template<size_t N>
+    constexpr bool assemble_adapter(code<N>& c, const source* sources, size_t count, size_t incoming, size_t literals_at, size_t target_at)
+    {
+        if (count > 4 || incoming > 4)
+            return false;
+        int from[4] = { -1, -1, -1, -1 };
+        bool loaded[4] = { };
+        for (size_t i = 0; i < count; i++)
+        {
+            if (sources[i].kind == source::literal)
+                loaded[i] = true;
+            else if (sources[i].kind == source::machine)
+            {
+                if (sources[i].index < r4 || sources[i].index > lr)
+                    return false;
+                from[i] = sources[i].index;
+            }
+            else if (sources[i].index >= incoming)
+                return false;
+            else if (sources[i].index != i)
+                from[i] = sources[i].index;
+        }
+        for (;;)
+        {
+            bool pending = false;
+            bool progress = false;
+            for (int d = 0; d < 4; d++)
+            {
+                if (from[d] < 0)
+                    continue;
+                pending = true;
+                bool still_needed = false;
+                for (int e = 0; e < 4; e++)
+                    if (e != d && from[e] == d)
+                        still_needed = true;
+                if (still_needed)
+                    continue;
+                c.emit(mov(reg(d), reg(from[d])));
+                from[d] = -1;
+                progress = true;
+            }
+            if (!pending)
+                break;
+            if (progress)
+                continue;
+            // Everything left is a cycle; park one value in r12 to break it.
+            for (int d = 0; d < 4; d++)
+                if (from[d] >= 0)
+                {
+                    c.emit(mov(r12, reg(d)));
+                    for (int e = 0; e < 4; e++)
+                        if (from[e] == d)
+                            from[e] = r12;
+                    break;
+                }
+        }
+        if (count < 4)
+        {
+            for (size_t i = 0; i < count; i++)
+                if (loaded[i])
+                    c.emit(ldr_literal(reg(i), c.here(), literals_at + sources[i].index * 4));
+            c.emit(ldr_literal(r3, c.here(), target_at));
+            c.emit(bx(r3));
+        }
+        else
+        {
+            int bounce = -1;
+            for (int i = 3; i >= 0; i--)
+                if (loaded[i])
+                    bounce = i;
+            if (bounce < 0)
+                return false;
+            c.emit(ldr_literal(reg(bounce), c.here(), target_at));
+            c.emit(mov(r12, reg(bounce)));
+            for (size_t i = 0; i < count; i++)
+                if (loaded[i])
+                    c.emit(ldr_literal(reg(i), c.here(), literals_at + sources[i].index * 4));
+            c.emit(bx(r12));
+        }
+        c.align();
+        return !c.failed;
+    }
+
+    /**
+     * @brief Assembles a thunk that passes self in r0, shifting the arguments up, and jumps through a table.
+     *
+     * The target is entry slot of whatever table a pointer variable currently points to, so every thunk
+     * sharing that variable changes target when it's stored to:
+     * ldr scratch, =&variable; ldr scratch, [scratch]; ldr scratch, [scratch, #slot * 4].
+     * With three arguments r3 is taken, so the target goes through r0 and then r12.
+     *
+     * @param count Number of incoming arguments, at most three.
+     * @param slot Table entry, at most 31.
+     * @param self_at Byte offset of the literal holding self.
+     * @param variable_at Byte offset of the literal holding the address of the table pointer.
+     */
+    template<size_t N>
+    constexpr bool assemble_table_call(code<N>& c, size_t count, size_t slot, size_t self_at, size_t variable_at)
+    {
+        if (count > 3)
+            return false;
+        for (size_t i = count; i > 0; i--)
+            c.emit(mov(reg(i), reg(i - 1)));
+        reg scratch = count < 3 ? r3 : r0;
+        c.emit(ldr_literal(scratch, c.here(), variable_at));
+        c.emit(ldr_immediate(scratch, scratch, 0));
+        c.emit(ldr_immediate(scratch, scratch, slot * 4));
+        if (count < 3)
+        {
+            c.emit(ldr_literal(r0, c.here(), self_at));
+            c.emit(bx(r3));
+        }
+        else
+        {
+            c.emit(mov(r12, r0));
+            c.emit(ldr_literal(r0, c.here(), self_at));
+            c.emit(bx(r12));
+        }
+        c.align();
+        return !c.failed;
+    }
+
+    /**
+     * @brief Assembles a block of entries, `movs r3, #k; b stub`, that share one stub computing self from k.
+     *
+     * The stub shifts the arguments up, passes base + k * size in r0, and jumps to the word the method literal
+     * points at, so entries are four bytes each. With the index in r3 there's only room for two arguments.
+     *
+     * @param count Number of incoming arguments, at most two.
+     * @param entries Number of entries, at most 256 (both for the immediate and the branch's reach).
+     * @param size_at Byte offset of the literal holding the object size.
+     * @param base_at Byte offset of the literal holding the address of object 0 of this block.
+     * @param method_at Byte offset of the literal holding the address of the method word.
+     */
+    template<size_t N>
+    constexpr bool assemble_indexed_block(code<N>& c, size_t count, size_t entries, size_t size_at, size_t base_at, size_t method_at)
+    {
+        if (count > 2 || entries > 256)
+            return false;
+        size_t stub_at = entries * 4;
+        for (size_t k = 0; k < entries; k++)
+        {
+            c.emit(movs(r3, k));
+            c.emit(b(c.here(), stub_at));
+        }
+        for (size_t i = count; i > 0; i--)
+            c.emit(mov(reg(i), reg(i - 1)));
+        c.emit(ldr_literal(r0, c.here(), size_at));
+        c.emit(muls(r3, r0));
+        c.emit(ldr_literal(r0, c.here(), base_at));
+        c.emit(adds(r0, r0, r3));
+        c.emit(ldr_literal(r3, c.here(), method_at));
+        c.emit(ldr_immediate(r3, r3, 0));
+        c.emit(bx(r3));
+        c.align();
+        return !c.failed;
+    }
+
+    /**
+     * @brief Most halfwords assemble_adapter can produce.
+     */
+    constexpr size_t max_adapter_length = 16;
+
+    /**
+     * @brief Halfwords assemble_adapter produces for this spec, padding included.
+     *
+     * The length doesn't depend on where the literals are, so this assembles against a dummy layout and measures.
+     */
+    constexpr size_t adapter_length(const source* sources, size_t count, size_t incoming)
+    {
+        code<max_adapter_length> c;
+        assemble_adapter(c, sources, count, incoming, max_adapter_length * 2, max_adapter_length * 2 + 16);
+        return c.size;
+    }
+}
+
+#endif /* THUMB_ASM_H */
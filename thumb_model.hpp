@@ -0,0 +1,705 @@
+#ifndef THUMB_MODEL_H
+#define THUMB_MODEL_H
+#include <stdint.h>
+#include <stddef.h>
+#include "thumb_asm.hpp"
+
+/**
+ * @brief Just enough of an ARMv6-M instruction set simulator to run trampoline thunks at compile time.
+ *
+ * We can't put hardware in CI, so instead every trampoline runs its own opcodes through this model
+ * in a static_assert and checks that the target gets the right registers.
+ * The cycle counts are from the Cortex-M0+ TRM, which is what the RP2040 has.
+ *
+ * Only the instructions the thunks actually use are understood; anything else stops the run and
+ * reports failure, so adding a new instruction to a thunk means teaching it to the model first.
+ */
+namespace thumb_model
+{
+    /**
+     * @brief Register state at the point the thunk branches away, plus what it cost to get there.
+     */
+    struct outcome
+    {
+        /**
+         * @brief False if the thunk ran into something the model doesn't understand or read outside its image.
+         */
+        bool ok = false;
+        uint32_t reg[16] = { };
+        /**
+         * @brief Address the thunk branched to.
+         */
+        uint32_t target = 0;
+        unsigned cycles = 0;
+        unsigned instructions = 0;
+    };
+
+    /**
+     * @brief Most instructions a run may take before it's declared lost; thunks are straight-line apart from the odd branch.
+     */
+    constexpr unsigned max_instructions = 64;
+
+    /**
+     * @brief Where a thunk's instructions and data live.
+     *
+     * image is the thunk and its literals as little-endian words, exactly as laid out in memory, with the code
+     * at byte offset zero; only the first halfwords of it are executable. memory is anything else the thunk may
+     * load from by address, memory_words of it starting at memory_base.
+     */
+    struct memory_map
+    {
+        const uint32_t* image = nullptr;
+        size_t words = 0;
+        size_t halfwords = 0;
+        const uint32_t* memory = nullptr;
+        uint32_t memory_base = 0;
+        size_t memory_words = 0;
+    };
+
+    /**
+     * @brief A thunk partway through running.
+     */
+    struct machine
+    {
+        outcome state;
+        size_t pc = 0;
+        /**
+         * @brief Set once the thunk has branched away (state.ok) or failed.
+         */
+        bool stopped = false;
+    };
+
+    /**
+     * @brief Executes one instruction, so the thunk can be interleaved with other things happening.
+     */
+    constexpr void step(machine& m, const memory_map& map)
+    {
+        outcome& state = m.state;
+        if (m.stopped)
+            return;
+        m.stopped = true; // until the instruction turns out to be understood
+        if (m.pc >= map.halfwords * 2)
+            return;
+        uint16_t op = map.image[m.pc / 4] >> (m.pc % 4 * 8);
+        if (++state.instructions > max_instructions)
+            return;
+        if ((op & 0xFF00) == 0x4600) // mov Rd, Rm (any registers)
+        {
+            unsigned d = ((op >> 4) & 8) | (op & 7);
+            unsigned n = (op >> 3) & 15;
+            if (d == 15)
+            {
+                state.target = state.reg[n];
+                state.cycles += 2;
+                state.ok = true;
+                return;
+            }
+            state.reg[d] = state.reg[n];
+            state.cycles += 1;
+        }
+        else if ((op & 0xF800) == 0x4800) // ldr Rt, [pc, #imm8 * 4]
+        {
+            size_t address = ((m.pc + 4) & ~size_t { 3 }) + (op & 0xFF) * 4;
+            if (address / 4 >= map.words)
+                return;
+            state.reg[(op >> 8) & 7] = map.image[address / 4];
+            state.cycles += 2;
+        }
+        else if ((op & 0xF800) == 0x6800) // ldr Rt, [Rn, #imm5 * 4]
+        {
+            uint32_t address = state.reg[(op >> 3) & 7] + ((op >> 6) & 31) * 4;
+            if (address % 4 || address < map.memory_base || (address - map.memory_base) / 4 >= map.memory_words)
+                return;
+            state.reg[op & 7] = map.memory[(address - map.memory_base) / 4];
+            state.cycles += 2;
+        }
+        else if ((op & 0xF800) == 0x2000) // movs Rd, #imm8
+        {
+            state.reg[(op >> 8) & 7] = op & 0xFF;
+            state.cycles += 1;
+        }
+        else if ((op & 0xFE00) == 0x1800) // adds Rd, Rn, Rm
+        {
+            state.reg[op & 7] = state.reg[(op >> 3) & 7] + state.reg[(op >> 6) & 7];
+            state.cycles += 1;
+        }
+        else if ((op & 0xFFC0) == 0x4340) // muls Rdm, Rn, Rdm
+        {
+            state.reg[op & 7] = state.reg[(op >> 3) & 7] * state.reg[op & 7];
+            state.cycles += 1;
+        }
+        else if ((op & 0xFF87) == 0x4700) // bx Rm
+        {
+            state.target = state.reg[(op >> 3) & 15];
+            state.cycles += 2;
+            state.ok = true;
+            return;
+        }
+        else if ((op & 0xF800) == 0xE000) // b label
+        {
+            ptrdiff_t offset = ptrdiff_t(op & 0x7FF) * 2 - ((op & 0x400) ? 4096 : 0);
+            ptrdiff_t destination = ptrdiff_t(m.pc) + 4 + offset;
+            if (destination < 0)
+                return;
+            m.pc = destination;
+            state.cycles += 2;
+            m.stopped = false;
+            return;
+        }
+        else if (op == 0xBF00) // nop
+            state.cycles += 1;
+        else
+            return;
+        m.pc += 2;
+        m.stopped = false;
+    }
+
+    /**
+     * @brief Executes a thunk.
+     *
+     * @param image The thunk and its literals, see memory_map.
+     * @param words Number of words in image.
+     * @param halfwords Number of opcodes at the start of image; running past them is a failure.
+     * Thunks with code after their literals pass the whole image and rely on never branching into data.
+     * @param registers Initial contents of r0 through r15 (r15 is ignored).
+     * @param memory Words the thunk may load from by address (anything outside image), starting at memory_base.
+     * @param entry Byte offset to start at, for images holding more than one entry point.
+     */
+    constexpr outcome run(const uint32_t* image, size_t words, size_t halfwords, const uint32_t (&registers)[16],
+        const uint32_t* memory = nullptr, uint32_t memory_base = 0, size_t memory_words = 0, size_t entry = 0)
+    {
+        machine m;
+        for (int i = 0; i < 16; i++)
+            m.state.reg[i] = registers[i];
+        m.pc = entry;
+        memory_map map { image, words, halfwords, memory, memory_base, memory_words };
+        while (!m.stopped)
+            step(m, map);
+        return m.state;
+    }
+
+    /**
+     * @brief Marker values the trampoline checks use to tell registers apart.
+     */
+    constexpr uint32_t self_marker = 0x5E1F5E1F;
+    constexpr uint32_t method_marker = 0x10C0DE01;
+    constexpr uint32_t argument_marker(int i) { return 0xA7600000 + i; }
+
+    /**
+     * @brief Runs a c_trampoline thunk laid out as opcodes, then self, then the pointer-to-member.
+     */
+    template<size_t Halfwords>
+    constexpr outcome run_trampoline(const uint16_t (&code)[Halfwords], uint32_t self, uint32_t method, uint32_t adjustment, const uint32_t (&registers)[16])
+    {
+        static_assert(Halfwords % 2 == 0, "Trampoline code must fill whole words so the literals stay aligned.");
+        constexpr size_t code_words = Halfwords / 2;
+        uint32_t image[code_words + 3] = { };
+        for (size_t i = 0; i < code_words; i++)
+            image[i] = code[i * 2] | uint32_t { code[i * 2 + 1] } << 16;
+        image[code_words] = self;
+        image[code_words + 1] = method;
+        image[code_words + 2] = adjustment; // which the thunk must ignore
+        return run(image, code_words + 3, Halfwords, registers);
+    }
+
+    /**
+     * @brief Runs a c_trampoline thunk with argument_marker(0..3) in r0-r3, self_marker, and method_marker.
+     */
+    template<size_t Halfwords>
+    constexpr outcome run_trampoline(const uint16_t (&code)[Halfwords])
+    {
+        return run_trampoline(code, self_marker, method_marker, 0, { argument_marker(0), argument_marker(1), argument_marker(2), argument_marker(3) });
+    }
+
+    /**
+     * @brief Checks that a run reached the method with self in r0 and the C arguments shifted up one register.
+     */
+    constexpr bool forwards_to_method(const outcome& result, int count)
+    {
+        if (!result.ok || result.target != method_marker || result.reg[0] != self_marker)
+            return false;
+        for (int i = 0; i < count; i++)
+            if (result.reg[i + 1] != argument_marker(i))
+                return false;
+        return true;
+    }
+
+    /**
+     * @brief Runs a c_trampoline thunk whose first halfword is entry, followed by a second thunk that the entry may branch to.
+     *
+     * Layout: main opcodes, self, the pointer-to-member (two words), alternate opcodes, context, target.
+     * This is how lazily bound trampolines look: entry is either main's own first instruction or a branch to
+     * the alternate path, which passes context in r0 instead.
+     */
+    template<size_t Main, size_t Alternate>
+    struct alternate_image
+    {
+        static constexpr size_t main_words = Main / 2;
+        static constexpr size_t words = main_words + 3 + Alternate / 2 + 2;
+        uint32_t word[words] = { };
+    };
+    template<size_t Main, size_t Alternate>
+    constexpr alternate_image<Main, Alternate> make_alternate_image(const uint16_t (&main)[Main], uint16_t entry, uint32_t self, uint32_t method,
+        const uint16_t (&alternate)[Alternate], uint32_t context, uint32_t target)
+    {
+        static_assert(Main % 2 == 0 && Alternate % 2 == 0, "Trampoline code must fill whole words so the literals stay aligned.");
+        constexpr size_t main_words = Main / 2;
+        constexpr size_t alternate_words = Alternate / 2;
+        alternate_image<Main, Alternate> image;
+        for (size_t i = 0; i < main_words; i++)
+            image.word[i] = (i ? main[i * 2] : entry) | uint32_t { main[i * 2 + 1] } << 16;
+        image.word[main_words] = self;
+        image.word[main_words + 1] = method;
+        image.word[main_words + 2] = 0;
+        for (size_t i = 0; i < alternate_words; i++)
+            image.word[main_words + 3 + i] = alternate[i * 2] | uint32_t { alternate[i * 2 + 1] } << 16;
+        image.word[main_words + 3 + alternate_words] = context;
+        image.word[main_words + 4 + alternate_words] = target;
+        return image;
+    }
+    template<size_t Main, size_t Alternate>
+    constexpr outcome run_with_alternate(const uint16_t (&main)[Main], uint16_t entry, uint32_t self, uint32_t method,
+        const uint16_t (&alternate)[Alternate], uint32_t context, uint32_t target, const uint32_t (&registers)[16])
+    {
+        alternate_image<Main, Alternate> image = make_alternate_image(main, entry, self, method, alternate, context, target);
+        return run(image.word, image.words, image.words * 2, registers);
+    }
+
+    /**
+     * @brief xorshift32, good enough for picking register contents.
+     */
+    constexpr uint32_t next_random(uint32_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    /**
+     * @brief Runs a table call thunk (see thumb_asm::assemble_table_call) laid out as opcodes, self, then the variable's address.
+     *
+     * memory is the variable followed by the table(s) it can point at, starting at memory_base.
+     */
+    template<size_t Halfwords, size_t Words>
+    constexpr outcome run_table_call(const uint16_t (&code)[Halfwords], uint32_t self, const uint32_t (&memory)[Words], uint32_t memory_base, const uint32_t (&registers)[16])
+    {
+        static_assert(Halfwords % 2 == 0, "Trampoline code must fill whole words so the literals stay aligned.");
+        constexpr size_t code_words = Halfwords / 2;
+        uint32_t image[code_words + 2] = { };
+        for (size_t i = 0; i < code_words; i++)
+            image[i] = code[i * 2] | uint32_t { code[i * 2 + 1] } << 16;
+        image[code_words] = self;
+        image[code_words + 1] = memory_base;
+        return run(image, code_words + 2, Halfwords, registers, memory, memory_base, Words);
+    }
+
+    /**
+     * @brief Differential check of a table call thunk against calling table[slot] directly with self and the arguments.
+     *
+     * Random registers, self, and table contents; the variable points at the table.
+     */
+    template<size_t Halfwords>
+    constexpr bool fuzz_table_call(const uint16_t (&code)[Halfwords], int count, size_t slot, unsigned rounds, uint32_t seed = 0x7A3F0E11)
+    {
+        constexpr uint32_t base = 0x20000100;
+        for (unsigned round = 0; round < rounds; round++)
+        {
+            uint32_t entry[16] = { };
+            for (uint32_t& r : entry)
+                r = next_random(seed);
+            uint32_t memory[33] = { base + 4 };
+            for (size_t i = 1; i < 33; i++)
+                memory[i] = next_random(seed) | 1;
+            uint32_t self = next_random(seed);
+            outcome result = run_table_call(code, self, memory, base, entry);
+            if (!result.ok || result.target != memory[1 + slot] || result.reg[0] != self)
+                return false;
+            for (int i = 0; i < count; i++)
+                if (result.reg[i + 1] != entry[i])
+                    return false;
+            for (int i = 4; i < 15; i++)
+                if (i != 12 && result.reg[i] != entry[i])
+                    return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Runs entry k of an indexed block (see thumb_asm::assemble_indexed_block) laid out as opcodes, then size, base, and the method word's address.
+     */
+    template<size_t Halfwords>
+    constexpr outcome run_indexed_block(const uint16_t (&code)[Halfwords], size_t k, uint32_t size, uint32_t base, uint32_t method, const uint32_t (&registers)[16])
+    {
+        static_assert(Halfwords % 2 == 0, "Trampoline code must fill whole words so the literals stay aligned.");
+        constexpr size_t code_words = Halfwords / 2;
+        constexpr uint32_t method_address = 0x20000100;
+        uint32_t image[code_words + 3] = { };
+        for (size_t i = 0; i < code_words; i++)
+            image[i] = code[i * 2] | uint32_t { code[i * 2 + 1] } << 16;
+        image[code_words] = size;
+        image[code_words + 1] = base;
+        image[code_words + 2] = method_address;
+        uint32_t memory[1] = { method };
+        return run(image, code_words + 3, Halfwords, registers, memory, method_address, 1, k * 4);
+    }
+
+    /**
+     * @brief Differential check of an indexed block against calling the method directly with base + k * size and the arguments.
+     *
+     * Checks entries 0 and entries - 1, plus random ones in between.
+     */
+    template<size_t Halfwords>
+    constexpr bool fuzz_indexed_block(const uint16_t (&code)[Halfwords], int count, size_t entries, unsigned rounds, uint32_t seed = 0x1D3C5B07)
+    {
+        for (unsigned round = 0; round < rounds; round++)
+        {
+            uint32_t entry[16] = { };
+            for (uint32_t& r : entry)
+                r = next_random(seed);
+            size_t k = round == 0 ? 0 : round == 1 ? entries - 1 : next_random(seed) % entries;
+            uint32_t size = next_random(seed) % 256 + 1;
+            uint32_t base = next_random(seed);
+            uint32_t method = next_random(seed) | 1;
+            outcome result = run_indexed_block(code, k, size, base, method, entry);
+            if (!result.ok || result.target != method || result.reg[0] != uint32_t(base + k * size))
+                return false;
+            for (int i = 0; i < count; i++)
+                if (result.reg[i + 1] != entry[i])
+                    return false;
+            for (int i = 4; i < 15; i++)
+                if (result.reg[i] != entry[i])
+                    return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Differential check of a c_trampoline thunk against a direct call to the method.
+     *
+     * Each round fills every register and literal with random values, runs the thunk, and compares the
+     * result with what a direct call would have set up: self in r0, the arguments in r1 onwards, and
+     * r4-r11, sp, and lr exactly as the caller left them (otherwise the method's return, and the
+     * return value with it, goes astray).
+     * Only r1-r3 above the arguments and r12 are allowed to differ, since the ABI doesn't preserve them.
+     */
+    template<size_t Halfwords>
+    constexpr bool fuzz_trampoline(const uint16_t (&code)[Halfwords], int count, unsigned rounds, uint32_t seed = 0x7A3F0E11)
+    {
+        for (unsigned round = 0; round < rounds; round++)
+        {
+            uint32_t entry[16] = { };
+            for (uint32_t& r : entry)
+                r = next_random(seed);
+            uint32_t self = next_random(seed);
+            uint32_t method = next_random(seed) | 1;
+            uint32_t adjustment = next_random(seed);
+            outcome result = run_trampoline(code, self, method, adjustment, entry);
+            if (!result.ok || result.target != method || result.reg[0] != self)
+                return false;
+            for (int i = 0; i < count; i++)
+                if (result.reg[i + 1] != entry[i])
+                    return false;
+            for (int i = 4; i < 15; i++)
+                if (i != 12 && result.reg[i] != entry[i])
+                    return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Runs an adapter thunk (see thumb_asm::assemble_adapter) laid out as opcodes, then its literals, then the target.
+     *
+     * A word after the target is included for trampolines whose target is a pointer-to-member.
+     */
+    template<size_t Halfwords, size_t Literals>
+    constexpr outcome run_adapter(const uint16_t (&code)[Halfwords], const uint32_t (&literals)[Literals], uint32_t target, uint32_t after, const uint32_t (&registers)[16])
+    {
+        static_assert(Halfwords % 2 == 0, "Adapter code must fill whole words so the literals stay aligned.");
+        constexpr size_t code_words = Halfwords / 2;
+        uint32_t image[code_words + Literals + 2] = { };
+        for (size_t i = 0; i < code_words; i++)
+            image[i] = code[i * 2] | uint32_t { code[i * 2 + 1] } << 16;
+        for (size_t i = 0; i < Literals; i++)
+            image[code_words + i] = literals[i];
+        image[code_words + Literals] = target;
+        image[code_words + Literals + 1] = after;
+        return run(image, code_words + Literals + 2, Halfwords, registers);
+    }
+
+    /**
+     * @brief Differential check of an adapter thunk against calling the target directly with the arguments sources describes.
+     *
+     * Same idea as fuzz_trampoline: random registers and literals, and everything the ABI says a
+     * callee preserves (r4-r11, sp, lr) must come through untouched.
+     */
+    template<size_t Literals, size_t Halfwords>
+    constexpr bool fuzz_adapter(const uint16_t (&code)[Halfwords], const thumb_asm::source* sources, size_t count, unsigned rounds, uint32_t seed = 0x7A3F0E11)
+    {
+        for (unsigned round = 0; round < rounds; round++)
+        {
+            uint32_t entry[16] = { };
+            for (uint32_t& r : entry)
+                r = next_random(seed);
+            uint32_t literals[Literals] = { };
+            for (uint32_t& l : literals)
+                l = next_random(seed);
+            uint32_t target = next_random(seed) | 1;
+            outcome result = run_adapter(code, literals, target, next_random(seed), entry);
+            if (!result.ok || result.target != target)
+                return false;
+            for (size_t i = 0; i < count; i++)
+                if (result.reg[i] != (sources[i].kind == thumb_asm::source::literal ? literals[sources[i].index] : entry[sources[i].index]))
+                    return false; // incoming and machine sources both index entry by register number
+            for (int i = 4; i < 15; i++)
+                if (i != 12 && result.reg[i] != entry[i])
+                    return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief A word store made by something running at the same time as a thunk, e.g. set_method from thread mode.
+     *
+     * Narrower stores are written as the whole word they land in, which is equivalent since nothing else writes it meanwhile.
+     */
+    struct store
+    {
+        enum area_kind : uint8_t
+        {
+            image_word, // a word of the thunk's own image
+            memory_word, // a word of the memory it loads from by address
+        };
+        area_kind area = image_word;
+        size_t index = 0;
+        uint32_t value = 0;
+        /**
+         * @brief The trampoline's lifetime ends here, so the thunk running any further (or starting) is use-after-destroy.
+         */
+        bool destroys = false;
+    };
+
+    /**
+     * @brief What explore() found, counted over every interleaving.
+     */
+    struct race_report
+    {
+        unsigned interleavings = 0;
+        /**
+         * @brief Runs that reached a target with registers that neither all-before nor all-after gives, i.e. a mix of old and new.
+         */
+        unsigned torn = 0;
+        /**
+         * @brief Runs still in the thunk when a destroying store happened.
+         */
+        unsigned after_destroy = 0;
+        /**
+         * @brief Runs the model couldn't finish, e.g. because a store left a half-written instruction, or that
+         * ended up somewhere other than where the check knows the call should go.
+         */
+        unsigned failed = 0;
+
+        constexpr bool clean() const
+        {
+            return !torn && !after_destroy && !failed;
+        }
+    };
+
+    template<size_t Words, size_t MemoryWords>
+    struct race_state
+    {
+        uint32_t image[Words] = { };
+        uint32_t memory[MemoryWords] = { };
+        machine m;
+        size_t stores_made = 0;
+        bool destroyed = false;
+
+        constexpr void apply(const store& s)
+        {
+            if (s.area == store::image_word)
+                image[s.index] = s.value;
+            else
+                memory[s.index] = s.value;
+            destroyed = destroyed || s.destroys;
+            stores_made++;
+        }
+        constexpr memory_map map(size_t halfwords, uint32_t memory_base) const
+        {
+            return { image, Words, halfwords, memory, memory_base, MemoryWords };
+        }
+    };
+
+    /**
+     * @brief True if a run ended up in the same place with the same r0-r3 as an acceptable one.
+     */
+    constexpr bool same_call(const outcome& a, const outcome& b)
+    {
+        if (a.target != b.target)
+            return false;
+        for (int i = 0; i < 4; i++)
+            if (a.reg[i] != b.reg[i])
+                return false;
+        return true;
+    }
+
+    template<size_t Words, size_t MemoryWords, size_t Stores>
+    constexpr void explore_from(race_state<Words, MemoryWords> s, size_t halfwords, uint32_t memory_base, const store (&stores)[Stores],
+        const outcome& before, const outcome& after, race_report& report)
+    {
+        if (s.stores_made < Stores)
+        {
+            race_state<Words, MemoryWords> next = s;
+            next.apply(stores[next.stores_made]);
+            explore_from(next, halfwords, memory_base, stores, before, after, report);
+        }
+        if (s.destroyed)
+        {
+            report.interleavings++;
+            report.after_destroy++;
+            return;
+        }
+        step(s.m, s.map(halfwords, memory_base));
+        if (!s.m.stopped)
+        {
+            explore_from(s, halfwords, memory_base, stores, before, after, report);
+            return;
+        }
+        report.interleavings++;
+        if (!s.m.state.ok)
+            report.failed++;
+        else if (!same_call(s.m.state, before) && !same_call(s.m.state, after))
+            report.torn++;
+    }
+
+    /**
+     * @brief Runs a thunk against every interleaving of its instructions with a sequence of stores, in order, from elsewhere.
+     *
+     * Each store is one aligned word, which the hardware makes atomic, and the stores happen in the order given,
+     * as they would from one context with barriers between them. The thunk is acceptable if it ends up making
+     * the call it would have made with none of the stores or with all of them; anything else is torn.
+     * Stores marked as destroying the trampoline mean it must not be running, or run, from then on.
+     *
+     * This is exhaustive, so keep it to short thunks and a handful of stores.
+     *
+     * @param image Thunk and literals, see memory_map.
+     * @param halfwords Executable halfwords at the start of image.
+     * @param memory Memory the thunk loads from by address.
+     * @param registers What the thunk is entered with.
+     * @param entry Byte offset the thunk starts at.
+     */
+    template<size_t Words, size_t MemoryWords, size_t Stores>
+    constexpr race_report explore(const uint32_t (&image)[Words], size_t halfwords, const uint32_t (&memory)[MemoryWords], uint32_t memory_base,
+        const store (&stores)[Stores], const uint32_t (&registers)[16], size_t entry = 0)
+    {
+        race_state<Words, MemoryWords> start;
+        for (size_t i = 0; i < Words; i++)
+            start.image[i] = image[i];
+        for (size_t i = 0; i < MemoryWords; i++)
+            start.memory[i] = memory[i];
+        for (int i = 0; i < 16; i++)
+            start.m.state.reg[i] = registers[i];
+        start.m.pc = entry;
+
+        race_state<Words, MemoryWords> before = start;
+        while (!before.m.stopped)
+            step(before.m, before.map(halfwords, memory_base));
+        race_state<Words, MemoryWords> after = start;
+        for (const store& s : stores)
+            after.apply(s);
+        while (!after.m.stopped)
+            step(after.m, after.map(halfwords, memory_base));
+
+        race_report report;
+        explore_from(start, halfwords, memory_base, stores, before.m.state, after.destroyed ? before.m.state : after.m.state, report);
+        return report;
+    }
+
+    /**
+     * @brief set_method on a c_trampoline racing a call: the method word and then the adjustment change.
+     */
+    template<size_t Halfwords>
+    constexpr race_report set_method_race(const uint16_t (&code)[Halfwords])
+    {
+        constexpr size_t code_words = Halfwords / 2;
+        uint32_t image[code_words + 3] = { };
+        for (size_t i = 0; i < code_words; i++)
+            image[i] = code[i * 2] | uint32_t { code[i * 2 + 1] } << 16;
+        image[code_words] = self_marker;
+        image[code_words + 1] = method_marker;
+        const store stores[] = { { store::image_word, code_words + 1, method_marker + 2 }, { store::image_word, code_words + 2, 1 } };
+        const uint32_t memory[1] = { };
+        return explore(image, Halfwords, memory, 0, stores, { argument_marker(0), argument_marker(1), argument_marker(2), argument_marker(3) });
+    }
+
+    /**
+     * @brief A c_trampoline destroyed while a call might be coming in: its first store ends its life.
+     *
+     * Never clean; after_destroy counts the interleavings where the call was in flight (or yet to start),
+     * which is how often the destruction race in the README can bite.
+     */
+    template<size_t Halfwords>
+    constexpr race_report destroy_race(const uint16_t (&code)[Halfwords])
+    {
+        constexpr size_t code_words = Halfwords / 2;
+        uint32_t image[code_words + 3] = { };
+        for (size_t i = 0; i < code_words; i++)
+            image[i] = code[i * 2] | uint32_t { code[i * 2 + 1] } << 16;
+        image[code_words] = self_marker;
+        image[code_words + 1] = method_marker;
+        const store stores[] = { { store::image_word, 0, uint32_t { thumb_asm::udf(0xD5) } * 0x10001, true } };
+        const uint32_t memory[1] = { };
+        return explore(image, Halfwords, memory, 0, stores, { argument_marker(0), argument_marker(1), argument_marker(2), argument_marker(3) });
+    }
+
+    /**
+     * @brief Binding a lazily bound trampoline (see run_with_alternate) racing a call: self and the entry branch change.
+     *
+     * @param self_first Store self before patching the entry, as bind() must.
+     */
+    template<size_t Main, size_t Alternate>
+    constexpr race_report bind_race(const uint16_t (&main)[Main], uint16_t unbound_entry, const uint16_t (&alternate)[Alternate], uint32_t context, uint32_t target, bool self_first)
+    {
+        alternate_image<Main, Alternate> image = make_alternate_image(main, unbound_entry, 0, method_marker, alternate, context, target);
+        store self { store::image_word, image.main_words, self_marker };
+        store entry { store::image_word, 0, main[0] | uint32_t { main[1] } << 16 };
+        const store stores[] = { self_first ? self : entry, self_first ? entry : self };
+        const uint32_t memory[1] = { };
+        return explore(image.word, image.words * 2, memory, 0, stores, { argument_marker(0), argument_marker(1), argument_marker(2), argument_marker(3) });
+    }
+
+    /**
+     * @brief Activating another profile racing a call through a table call thunk (see run_table_call): one store to the variable.
+     *
+     * The call has to reach slot's entry in either the old profile or the new one.
+     */
+    template<size_t Halfwords>
+    constexpr race_report activate_race(const uint16_t (&code)[Halfwords], size_t slot)
+    {
+        constexpr size_t code_words = Halfwords / 2;
+        constexpr uint32_t base = 0x20000100;
+        uint32_t image[code_words + 2] = { };
+        for (size_t i = 0; i < code_words; i++)
+            image[i] = code[i * 2] | uint32_t { code[i * 2 + 1] } << 16;
+        image[code_words] = self_marker;
+        image[code_words + 1] = base;
+        uint32_t memory[1 + 32 * 2] = { base + 4 };
+        for (size_t i = 0; i < 32; i++)
+        {
+            memory[1 + i] = method_marker + 2 * i;
+            memory[33 + i] = method_marker + 0x1000 + 2 * i;
+        }
+        const store stores[] = { { store::memory_word, 0, base + 4 + 32 * 4 } };
+        race_report report = explore(image, Halfwords, memory, base, stores, { argument_marker(0), argument_marker(1), argument_marker(2), argument_marker(3) });
+        // Agreeing with one end or the other only helps if the ends are slot's entry in the old profile and in the new one.
+        uint32_t activated[1 + 32 * 2] = { };
+        for (size_t i = 0; i < 1 + 32 * 2; i++)
+            activated[i] = memory[i];
+        activated[0] = stores[0].value;
+        if (run_table_call(code, self_marker, memory, base, { }).target != memory[1 + slot]
+            || run_table_call(code, self_marker, activated, base, { }).target != memory[33 + slot])
+            report.failed++;
+        return report;
+    }
+}
+
+#endif /* THUMB_MODEL_H */